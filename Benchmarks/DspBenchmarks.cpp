@@ -0,0 +1,779 @@
+#include "../Source/PluginProcessor.h"
+
+// Microbenchmarks for the DSP paths, from single buffer reads up to full processBlock calls.
+//
+//   GranularFxBenchmarks [--quick] [--filter <text>] [--seconds <s>] [--repeats <n>] [--json <file>|-]
+//
+// Every case is timed --repeats times and the fastest run is kept. --json writes the results in a
+// machine-readable form for comparing builds, "-" prints it to stdout instead of the table.
+
+namespace {
+    constexpr double sampleRate = 48000.0;
+
+    struct Result {
+        juce::String name;
+        juce::NamedValueSet params;
+        double nsPerSample = 0.0;
+        double grainsPerSecond = 0.0;
+        double realtime = 0.0;
+    };
+
+    struct Options {
+        bool quick = false;
+        juce::String filter;
+        double seconds = 2.0;
+        int repeats = 5;
+    };
+
+    // Keeps the optimiser from dropping work whose result is otherwise unused
+    volatile float sink = 0.0f;
+
+    template <typename Fn>
+    double timeBest(int repeats, Fn&& run) {
+        double best = std::numeric_limits<double>::max();
+
+        for (int r = 0; r < repeats; ++r) {
+            const auto start = juce::Time::getHighResolutionTicks();
+            run();
+            best = std::min(best, juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start));
+        }
+
+        return best;
+    }
+
+    void fillNoise(float* dest, int numSamples, juce::Random& random) {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] = random.nextFloat() * 2.0f - 1.0f;
+    }
+
+    // Noise in every channel of the history, a frame at a time
+    void fillHistory(CircularBuffer& buffer, int numSamples, juce::Random& random) {
+        std::array<float, CircularBuffer::maxChannels> frame;
+
+        for (int i = 0; i < numSamples; ++i) {
+            fillNoise(frame.data(), buffer.getNumChannels(), random);
+            buffer.write(frame.data(), i);
+        }
+    }
+
+    // Output spans for every channel a pool can render
+    struct SpanOutputs {
+        std::array<std::array<float, GrainPool::maxSpanSamples>, GrainPool::maxChannels> spans;
+        std::array<float*, GrainPool::maxChannels> pointers;
+
+        SpanOutputs() {
+            for (size_t channel = 0; channel < spans.size(); ++channel)
+                pointers[channel] = spans[channel].data();
+        }
+
+        void clear() {
+            for (auto& span : spans)
+                span.fill(0.0f);
+        }
+    };
+
+    juce::String describe(const juce::NamedValueSet& params) {
+        juce::StringArray parts;
+        for (const auto& p : params)
+            parts.add(p.name.toString() + "=" + p.value.toString());
+        return parts.joinIntoString(" ");
+    }
+
+    class Suite {
+    public:
+        explicit Suite(const Options& o) : options(o) {}
+
+        bool wants(const juce::String& name) const {
+            return options.filter.isEmpty() || name.containsIgnoreCase(options.filter);
+        }
+
+        void add(Result result) {
+            std::cerr << result.name << " " << describe(result.params) << ": "
+                      << juce::String(result.nsPerSample, 2) << " ns/sample";
+            if (result.grainsPerSecond > 0.0) std::cerr << ", " << juce::String(result.grainsPerSecond / 1.0e6, 2) << " M grain-samples/s";
+            if (result.realtime > 0.0) std::cerr << ", " << juce::String(result.realtime, 1) << "x realtime";
+            std::cerr << std::endl;
+
+            results.push_back(std::move(result));
+        }
+
+        juce::String toJson() const {
+            auto* root = new juce::DynamicObject();
+            root->setProperty("cpu", juce::SystemStats::getCpuModel());
+            root->setProperty("avx2", juce::SystemStats::hasAVX2());
+            root->setProperty("sampleRate", sampleRate);
+            root->setProperty("repeats", options.repeats);
+
+            juce::Array<juce::var> entries;
+            for (const auto& r : results) {
+                auto* entry = new juce::DynamicObject();
+                entry->setProperty("name", r.name);
+
+                auto* params = new juce::DynamicObject();
+                for (const auto& p : r.params)
+                    params->setProperty(p.name, p.value);
+
+                entry->setProperty("params", juce::var(params));
+                entry->setProperty("nsPerSample", r.nsPerSample);
+                entry->setProperty("grainsPerSecond", r.grainsPerSecond);
+                entry->setProperty("realtime", r.realtime);
+                entries.add(juce::var(entry));
+            }
+
+            root->setProperty("results", entries);
+            return juce::JSON::toString(juce::var(root));
+        }
+
+        // For checks that ride along with a benchmark, makes the run exit with an error
+        void fail(const juce::String& message) {
+            std::cerr << "FAILED: " << message << std::endl;
+            failed = true;
+        }
+
+        bool hasFailed() const { return failed; }
+
+        const Options& options;
+
+    private:
+        std::vector<Result> results;
+        bool failed = false;
+    };
+
+    //==============================================================================
+    void benchmarkBufferReads(Suite& suite) {
+        if (!suite.wants("circularBuffer.read")) return;
+
+        constexpr int bufferSamples = 1 << 18;
+        constexpr int numReads = 1 << 16;
+
+        // In range reads sweep the middle of the buffer, wrapping reads straddle its end so taps cross over
+        std::vector<double> inRange((size_t)numReads), wrapping((size_t)numReads);
+        for (int i = 0; i < numReads; ++i) {
+            inRange[(size_t)i] = bufferSamples / 4 + i * 1.37;
+            wrapping[(size_t)i] = bufferSamples - 4 + (i % 64) * 0.13;
+        }
+
+        auto names = Interpolation::getModeNames();
+        auto formatNames = Interpolation::getFormatNames();
+        auto layoutNames = Interpolation::getLayoutNames();
+
+        for (int format = 0; format < (int)HistoryFormat::numFormats; ++format) {
+            for (int layout = 0; layout < (int)HistoryLayout::numLayouts; ++layout) {
+                CircularBuffer buffer;
+                buffer.setFormat((HistoryFormat)format);
+                buffer.setLayout((HistoryLayout)layout);
+                buffer.respace(bufferSamples);
+
+                juce::Random random(1);
+                fillHistory(buffer, bufferSamples, random);
+
+                for (int mode = 0; mode < (int)InterpolationMode::numModes; ++mode) {
+                    for (auto* indices : { &inRange, &wrapping }) {
+                        const double seconds = timeBest(suite.options.repeats, [&] {
+                            float sum = 0.0f;
+                            for (double index : *indices)
+                                sum += buffer.read(0, index, (InterpolationMode)mode, 1.37f);
+                            sink = sum;
+                        });
+
+                        Result r;
+                        r.name = "circularBuffer.read";
+                        r.params.set("format", formatNames[format]);
+                        r.params.set("layout", layoutNames[layout]);
+                        r.params.set("interpolation", names[mode]);
+                        r.params.set("case", indices == &inRange ? "inRange" : "wrapping");
+                        r.nsPerSample = seconds * 1.0e9 / numReads;
+                        suite.add(r);
+                    }
+                }
+            }
+        }
+    }
+
+    //==============================================================================
+    // Both channels at scattered positions, where each read misses the cache and the layout decides
+    // whether the second channel does too. Reported per stereo frame.
+    template <InterpolationMode mode>
+    void timeStereoReads(Suite& suite, const CircularBuffer& buffer, const std::vector<int32_t>& positions) {
+        const int band = Interpolation::SincTables::getBand(1.37f);
+
+        const double seconds = timeBest(suite.options.repeats, [&] {
+            float sum = 0.0f;
+            for (int32_t index : positions) {
+                const auto frame = buffer.readStereo<mode>(index, 0.37f, band);
+                sum += frame.left + frame.right;
+            }
+            sink = sum;
+        });
+
+        Result r;
+        r.name = "circularBuffer.readStereo";
+        r.params.set("format", Interpolation::getFormatNames()[(int)buffer.getFormat()]);
+        r.params.set("layout", Interpolation::getLayoutNames()[(int)buffer.getLayout()]);
+        r.params.set("interpolation", Interpolation::getModeNames()[(int)mode]);
+        r.nsPerSample = seconds * 1.0e9 / (double)positions.size();
+        suite.add(r);
+    }
+
+    void benchmarkStereoReads(Suite& suite) {
+        if (!suite.wants("circularBuffer.readStereo")) return;
+
+        // Larger than the last level cache, so the scattered reads really go to memory
+        constexpr int bufferSamples = 1 << 22;
+        constexpr int numReads = 1 << 16;
+
+        juce::Random random(4);
+        std::vector<int32_t> positions((size_t)numReads);
+        for (auto& p : positions)
+            p = random.nextInt(bufferSamples);
+
+        for (int format = 0; format < (int)HistoryFormat::numFormats; ++format) {
+            for (int layout = 0; layout < (int)HistoryLayout::numLayouts; ++layout) {
+                CircularBuffer buffer;
+                buffer.setFormat((HistoryFormat)format);
+                buffer.setLayout((HistoryLayout)layout);
+                buffer.respace(bufferSamples);
+
+                std::vector<float> noiseL((size_t)bufferSamples), noiseR((size_t)bufferSamples);
+                fillNoise(noiseL.data(), bufferSamples, random);
+                fillNoise(noiseR.data(), bufferSamples, random);
+                const float* noise[] = { noiseL.data(), noiseR.data() };
+                buffer.writeSpan(noise, 0, bufferSamples);
+
+                timeStereoReads<InterpolationMode::linear>(suite, buffer, positions);
+                timeStereoReads<InterpolationMode::hermite>(suite, buffer, positions);
+                timeStereoReads<InterpolationMode::sinc>(suite, buffer, positions);
+            }
+        }
+    }
+
+    //==============================================================================
+    void benchmarkGrainPool(Suite& suite) {
+        if (!suite.wants("grainPool.renderSpan")) return;
+
+        constexpr int bufferSamples = 1 << 18;
+        constexpr int numSpans = 2048;
+        constexpr int spanSamples = GrainPool::maxSpanSamples;
+
+        // The same history in every storage format and layout
+        constexpr int numLayouts = (int)HistoryLayout::numLayouts;
+        std::array<CircularBuffer, (size_t)HistoryFormat::numFormats * numLayouts> buffers;
+
+        for (int format = 0; format < (int)HistoryFormat::numFormats; ++format) {
+            for (int layout = 0; layout < numLayouts; ++layout) {
+                auto& buffer = buffers[(size_t)(format * numLayouts + layout)];
+                buffer.setFormat((HistoryFormat)format);
+                buffer.setLayout((HistoryLayout)layout);
+                buffer.respace(bufferSamples);
+
+                juce::Random random(2);
+                fillHistory(buffer, bufferSamples, random);
+            }
+        }
+
+        auto pool = std::make_unique<GrainPool>();
+        SpanOutputs out;
+        const float gains[] = { 0.7f, 0.7f };
+
+        auto names = Interpolation::getModeNames();
+        auto formatNames = Interpolation::getFormatNames();
+        auto layoutNames = Interpolation::getLayoutNames();
+        const std::vector<int> grainCounts = suite.options.quick ? std::vector<int> { 8, 32 } : std::vector<int> { 1, 4, 8, 16, 32 };
+        const std::vector<float> pitches = suite.options.quick ? std::vector<float> { 1.0f, 4.0f } : std::vector<float> { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f };
+
+        // The same grain counts in the default and the largest pool, cost should only follow the live grains
+        const std::vector<int> capacities = suite.options.quick ? std::vector<int> { GrainPool::defaultCapacity }
+                                                                : std::vector<int> { GrainPool::defaultCapacity, GrainPool::maxCapacity };
+
+        for (const auto& buffer : buffers) {
+
+            for (int capacity : capacities) {
+                pool->setCapacity(capacity);
+
+                for (int mode = 0; mode < (int)InterpolationMode::numModes; ++mode) {
+                    for (int grains : grainCounts) {
+                        for (float pitch : pitches) {
+                            const double seconds = timeBest(suite.options.repeats, [&] {
+                                pool->reset();
+
+                                // Long enough that no grain finishes during the run
+                                for (int g = 0; g < grains; ++g) {
+                                    const GrainPool::HeadParams heads[] = { { 1 << 20, 1000.0 + g * 97.0, pitch },
+                                                                            { 1 << 20, 1100.0 + g * 89.0, pitch } };
+                                    pool->trigger(bufferSamples / 2, heads, gains, g % 2 == 0, g % WindowTables::numShapes);
+                                }
+
+                                for (int span = 0; span < numSpans; ++span) {
+                                    out.clear();
+                                    pool->renderSpan(buffer, out.pointers.data(), spanSamples, span * spanSamples,
+                                                     buffer.getMask(), (InterpolationMode)mode, nullptr, nullptr);
+                                }
+
+                                sink = out.spans[0][0] + out.spans[1][0];
+                            });
+
+                            const double samples = (double)numSpans * spanSamples;
+
+                            Result r;
+                            r.name = "grainPool.renderSpan";
+                            r.params.set("format", formatNames[(int)buffer.getFormat()]);
+                            r.params.set("layout", layoutNames[(int)buffer.getLayout()]);
+                            r.params.set("interpolation", names[mode]);
+                            r.params.set("capacity", capacity);
+                            r.params.set("grains", grains);
+                            r.params.set("pitch", pitch);
+                            r.nsPerSample = seconds * 1.0e9 / samples;
+                            r.grainsPerSecond = grains * samples / seconds;
+                            suite.add(r);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //==============================================================================
+    // Dense clouds split across helper threads, threads=0 is the single-threaded fallback for reference
+    void benchmarkParallelGrainPool(Suite& suite) {
+        if (!suite.wants("grainPool.parallel")) return;
+
+        constexpr int bufferSamples = 1 << 18;
+        constexpr int numSpans = 512;
+        constexpr int spanSamples = GrainPool::maxSpanSamples;
+
+        CircularBuffer buffer;
+        buffer.respace(bufferSamples);
+
+        juce::Random random(5);
+        fillHistory(buffer, bufferSamples, random);
+
+        auto pool = std::make_unique<GrainPool>();
+        pool->setCapacity(GrainPool::maxCapacity);
+
+        SpanOutputs out;
+        const float gains[] = { 0.7f, 0.7f };
+
+        const int maxThreads = juce::jmin(GrainRenderWorkers::maxWorkers, juce::SystemStats::getNumCpus() - 1);
+        const std::vector<int> grainCounts = suite.options.quick ? std::vector<int> { 1024 } : std::vector<int> { 256, 1024, 4096 };
+
+        for (int threads : { 0, 1, 3, 7 }) {
+            if (threads > maxThreads) continue;
+
+            GrainRenderWorkers workers;
+            workers.start(threads, numSpans * spanSamples / sampleRate);
+            pool->setWorkers(&workers);
+
+            for (int grains : grainCounts) {
+                const double seconds = timeBest(suite.options.repeats, [&] {
+                    pool->reset();
+
+                    for (int g = 0; g < grains; ++g) {
+                        const GrainPool::HeadParams heads[] = { { 1 << 20, 1000.0 + g * 37.0, 1.0 + (g % 7) * 0.25 },
+                                                                { 1 << 20, 1100.0 + g * 31.0, 1.0 + (g % 5) * 0.25 } };
+                        pool->trigger(bufferSamples / 2, heads, gains, g % 2 == 0, g % WindowTables::numShapes);
+                    }
+
+                    workers.beginBlock();
+
+                    for (int span = 0; span < numSpans; ++span) {
+                        out.clear();
+                        pool->renderSpan(buffer, out.pointers.data(), spanSamples, span * spanSamples,
+                                         buffer.getMask(), InterpolationMode::linear, nullptr, nullptr);
+                    }
+
+                    workers.endBlock();
+                    sink = out.spans[0][0] + out.spans[1][0];
+                });
+
+                const double samples = (double)numSpans * spanSamples;
+
+                Result r;
+                r.name = "grainPool.parallel";
+                r.params.set("threads", threads);
+                r.params.set("grains", grains);
+                r.nsPerSample = seconds * 1.0e9 / samples;
+                r.grainsPerSecond = grains * samples / seconds;
+                r.realtime = (samples / sampleRate) / seconds;
+                suite.add(r);
+            }
+
+            workers.stop();
+            pool->setWorkers(nullptr);
+        }
+    }
+
+    //==============================================================================
+    // The same cloud over larger speaker layouts. Channels on one side share a read head, so cost should
+    // grow well below the channel count.
+    void benchmarkGrainPoolLayouts(Suite& suite) {
+        if (!suite.wants("grainPool.layout")) return;
+
+        constexpr int bufferSamples = 1 << 18;
+        constexpr int numSpans = 2048;
+        constexpr int spanSamples = GrainPool::maxSpanSamples;
+        constexpr int grains = 32;
+
+        const std::vector<std::pair<juce::String, juce::AudioChannelSet>> layouts {
+            { "stereo", juce::AudioChannelSet::stereo() },
+            { "quad", juce::AudioChannelSet::quadraphonic() },
+            { "5.1", juce::AudioChannelSet::create5point1() },
+            { "7.1.4", juce::AudioChannelSet::create7point1point4() }
+        };
+
+        auto names = Interpolation::getModeNames();
+        auto pool = std::make_unique<GrainPool>();
+        SpanOutputs out;
+
+        for (const auto& [layoutName, channelSet] : layouts) {
+            SpeakerLayout layout;
+            layout.setChannelSet(channelSet);
+            pool->setLayout(layout);
+
+            CircularBuffer buffer;
+            buffer.setNumChannels(layout.getNumChannels());
+            buffer.respace(bufferSamples);
+
+            juce::Random random(6);
+            fillHistory(buffer, bufferSamples, random);
+
+            for (int mode = 0; mode < (int)InterpolationMode::numModes; ++mode) {
+                const double seconds = timeBest(suite.options.repeats, [&] {
+                    pool->reset();
+
+                    for (int g = 0; g < grains; ++g) {
+                        std::array<GrainPool::HeadParams, GrainPool::maxHeads> heads;
+                        for (int head = 0; head < layout.getNumHeads(); ++head)
+                            heads[(size_t)head] = { 1 << 20, 1000.0 + g * 97.0 + head * 89.0, 1.0 + (g % 4) * 0.25 };
+
+                        std::array<float, GrainPool::maxChannels> gains;
+                        layout.getGains((float)(g % 9) / 4.0f - 1.0f, 0.5f, 1.0f, gains.data());
+
+                        pool->trigger(bufferSamples / 2, heads.data(), gains.data(), g % 2 == 0, g % WindowTables::numShapes);
+                    }
+
+                    for (int span = 0; span < numSpans; ++span) {
+                        out.clear();
+                        pool->renderSpan(buffer, out.pointers.data(), spanSamples, span * spanSamples,
+                                         buffer.getMask(), (InterpolationMode)mode, nullptr, nullptr);
+                    }
+
+                    sink = out.spans[0][0] + out.spans[1][0];
+                });
+
+                const double samples = (double)numSpans * spanSamples;
+
+                Result r;
+                r.name = "grainPool.layout";
+                r.params.set("layout", layoutName);
+                r.params.set("channels", layout.getNumChannels());
+                r.params.set("heads", layout.getNumHeads());
+                r.params.set("interpolation", names[mode]);
+                r.params.set("grains", grains);
+                r.nsPerSample = seconds * 1.0e9 / samples;
+                r.grainsPerSecond = grains * samples / seconds;
+                suite.add(r);
+            }
+        }
+    }
+
+    //==============================================================================
+    void benchmarkFeedbackChain(Suite& suite) {
+        if (!suite.wants("feedbackChain.process")) return;
+
+        constexpr int numSamples = 1 << 16;
+        constexpr int maxChannels = FeedbackChain::maxChannels;
+
+        juce::AudioBuffer<float> input(maxChannels, numSamples);
+        juce::Random random(3);
+        for (int channel = 0; channel < maxChannels; ++channel)
+            fillNoise(input.getWritePointer(channel), numSamples, random);
+
+        const float toneAlpha = FeedbackChain::getToneAlpha(0.5f, sampleRate);
+        FeedbackChain chain;
+        juce::AudioBuffer<float> audio(maxChannels, numSamples);
+
+        // Control interval sized blocks, the way the processor calls it. Reported per frame of all channels.
+        for (int channels : { 2, 6, 12 }) {
+            for (int blockSize : { 32, 64 }) {
+                const double seconds = timeBest(suite.options.repeats, [&] {
+                    audio.makeCopyOf(input, true);
+
+                    for (int i = 0; i < numSamples; i += blockSize) {
+                        std::array<float*, maxChannels> block;
+                        for (int channel = 0; channel < channels; ++channel)
+                            block[(size_t)channel] = audio.getWritePointer(channel, i);
+
+                        chain.process(block.data(), channels, blockSize, toneAlpha);
+                    }
+
+                    sink = audio.getSample(0, numSamples - 1) + audio.getSample(channels - 1, numSamples - 1);
+                });
+
+                Result r;
+                r.name = "feedbackChain.process";
+                r.params.set("channels", channels);
+                r.params.set("block", blockSize);
+                r.nsPerSample = seconds * 1.0e9 / numSamples;
+                suite.add(r);
+            }
+        }
+    }
+
+    //==============================================================================
+    // fastTanh against std::tanh, for speed and for accuracy. Going over FeedbackChain::maxTanhError fails the run.
+    void benchmarkTanh(Suite& suite) {
+        if (!suite.wants("feedbackChain.tanh")) return;
+
+        constexpr int numSamples = 1 << 16;
+
+        // Dense around the knee, plus values far past the clamp and around the linear cutoff
+        std::vector<float> input((size_t)numSamples);
+        for (int i = 0; i < numSamples; ++i)
+            input[(size_t)i] = juce::jmap((float)i, 0.0f, (float)numSamples, -10.0f, 10.0f);
+        for (float x : { 0.0f, 1.0e-6f, 0.0004f, -0.0004f, 7.9f, 50.0f, -1.0e6f, std::numeric_limits<float>::max() })
+            input.push_back(x);
+
+        std::vector<float> output(input.size());
+
+        for (bool fast : { false, true }) {
+            const double seconds = timeBest(suite.options.repeats, [&] {
+                std::copy(input.begin(), input.end(), output.begin());
+
+                if (fast) {
+                    FeedbackChain::saturate(output.data(), (int)output.size());
+                }
+                else {
+                    for (auto& x : output)
+                        x = std::tanh(x);
+                }
+
+                sink = output[1];
+            });
+
+            // The scalar version handles block tails, so it is checked along with the vector one
+            double maxError = 0.0;
+            for (size_t i = 0; i < input.size(); ++i) {
+                const double reference = std::tanh((double)input[i]);
+                maxError = std::max(maxError, std::abs((double)output[i] - reference));
+                if (fast) maxError = std::max(maxError, std::abs((double)FeedbackChain::fastTanh(input[i]) - reference));
+            }
+
+            Result r;
+            r.name = "feedbackChain.tanh";
+            r.params.set("impl", fast ? "fast" : "std");
+            r.params.set("maxError", maxError);
+            r.nsPerSample = seconds * 1.0e9 / (double)output.size();
+            suite.add(r);
+
+            if (fast && maxError > FeedbackChain::maxTanhError)
+                suite.fail("fastTanh error " + juce::String(maxError) + " is over " + juce::String(FeedbackChain::maxTanhError));
+        }
+    }
+
+    //==============================================================================
+    void setParameter(AudioPluginAudioProcessor& processor, ParamID id, float value) {
+        auto* param = processor.apvts.getParameter(ParameterIDs::get(id));
+        jassert(param != nullptr);
+        param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    // Densities past the parameter's range go through the smallest multiplier that reaches them
+    void setDensity(AudioPluginAudioProcessor& processor, float density) {
+        const auto& multipliers = AudioPluginAudioProcessor::densityMultipliers;
+        const auto* param = processor.apvts.getParameter(ParameterIDs::get(ParamID::density));
+        const float maxDensity = param->convertFrom0to1(1.0f);
+
+        size_t choice = 0;
+        while (choice + 1 < multipliers.size() && density > maxDensity * multipliers[choice])
+            ++choice;
+
+        setParameter(processor, ParamID::densityMultiplier, (float)choice);
+        setParameter(processor, ParamID::density, density / multipliers[choice]);
+    }
+
+    void benchmarkProcessBlock(Suite& suite) {
+        if (!suite.wants("processBlock")) return;
+
+        const std::vector<int> blockSizes = suite.options.quick ? std::vector<int> { 64, 512 } : std::vector<int> { 32, 64, 128, 256, 512, 1024, 2048 };
+        const std::vector<float> densities = suite.options.quick ? std::vector<float> { 1.0f, 32.0f } : std::vector<float> { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 128.0f, 512.0f };
+        const std::vector<float> pitches = suite.options.quick ? std::vector<float> { 0.25f, 4.0f } : std::vector<float> { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f };
+
+        const int totalSamples = (int)(suite.options.seconds * sampleRate);
+
+        juce::AudioBuffer<float> input(2, totalSamples);
+        juce::Random random(4);
+        fillNoise(input.getWritePointer(0), totalSamples, random);
+        fillNoise(input.getWritePointer(1), totalSamples, random);
+
+        juce::AudioBuffer<float> audio(2, totalSamples);
+        juce::MidiBuffer midi;
+
+        for (int blockSize : blockSizes) {
+            for (float density : densities) {
+                for (float pitch : pitches) {
+                    double best = std::numeric_limits<double>::max();
+                    double activeGrainSamples = 0.0;
+
+                    for (int rep = 0; rep < suite.options.repeats; ++rep) {
+                        AudioPluginAudioProcessor processor;
+                        setParameter(processor, ParamID::seed, 1.0f);
+                        setDensity(processor, density);
+                        setParameter(processor, ParamID::pitch, pitch);
+                        setParameter(processor, ParamID::feedback, 0.5f);
+                        setParameter(processor, ParamID::mix, 0.5f);
+
+                        processor.setPlayConfigDetails(2, 2, sampleRate, blockSize);
+                        processor.prepareToPlay(sampleRate, blockSize);
+
+                        audio.makeCopyOf(input, true);
+
+                        // Only processBlock is timed, counting grains between blocks stays outside
+                        double seconds = 0.0;
+                        double grainSamples = 0.0;
+
+                        for (int pos = 0; pos < totalSamples; pos += blockSize) {
+                            const int numSamples = juce::jmin(blockSize, totalSamples - pos);
+                            juce::AudioBuffer<float> block(audio.getArrayOfWritePointers(), 2, pos, numSamples);
+
+                            const auto start = juce::Time::getHighResolutionTicks();
+                            processor.processBlock(block, midi);
+                            seconds += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+                            grainSamples += (double)processor.grainPool.getNumActive() * numSamples;
+                        }
+
+                        if (seconds < best) {
+                            best = seconds;
+                            activeGrainSamples = grainSamples;
+                        }
+                    }
+
+                    Result r;
+                    r.name = "processBlock";
+                    r.params.set("blockSize", blockSize);
+                    r.params.set("density", density);
+                    r.params.set("pitch", pitch);
+                    r.nsPerSample = best * 1.0e9 / totalSamples;
+                    r.grainsPerSecond = activeGrainSamples / best;
+                    r.realtime = (totalSamples / sampleRate) / best;
+                    suite.add(r);
+                }
+            }
+        }
+    }
+
+    // Per-block cost of running from scenes: none (on the second scene's values), the first scene fixed,
+    // and a morph between the two moving every block, so the smoothers keep gliding.
+    void benchmarkSceneMorph(Suite& suite) {
+        if (!suite.wants("sceneMorph")) return;
+
+        const std::vector<int> blockSizes = suite.options.quick ? std::vector<int> { 64 } : std::vector<int> { 32, 64, 256, 1024 };
+        const int totalSamples = (int)(suite.options.seconds * sampleRate);
+
+        juce::AudioBuffer<float> input(2, totalSamples);
+        juce::Random random(6);
+        fillNoise(input.getWritePointer(0), totalSamples, random);
+        fillNoise(input.getWritePointer(1), totalSamples, random);
+
+        juce::AudioBuffer<float> audio(2, totalSamples);
+        juce::MidiBuffer midi;
+
+        const std::array<const char*, 3> modes { "off", "fixed", "moving" };
+
+        for (int blockSize : blockSizes) {
+            for (int mode = 0; mode < (int)modes.size(); ++mode) {
+                double best = std::numeric_limits<double>::max();
+
+                for (int rep = 0; rep < suite.options.repeats; ++rep) {
+                    AudioPluginAudioProcessor processor;
+                    setParameter(processor, ParamID::seed, 1.0f);
+                    setParameter(processor, ParamID::density, 8.0f);
+                    processor.storePreset(0);
+
+                    setParameter(processor, ParamID::density, 16.0f);
+                    setParameter(processor, ParamID::pitch, 0.5f);
+                    setParameter(processor, ParamID::splice, 200.0f);
+                    setParameter(processor, ParamID::feedback, 0.3f);
+                    processor.storePreset(1);
+
+                    if (mode > 0) processor.setMorphScenes(0, 1);
+
+                    processor.setPlayConfigDetails(2, 2, sampleRate, blockSize);
+                    processor.prepareToPlay(sampleRate, blockSize);
+
+                    audio.makeCopyOf(input, true);
+                    auto* morph = processor.apvts.getParameter(ParameterIDs::get(ParamID::morph));
+
+                    // Only processBlock is timed
+                    double seconds = 0.0;
+
+                    for (int pos = 0; pos < totalSamples; pos += blockSize) {
+                        const int numSamples = juce::jmin(blockSize, totalSamples - pos);
+                        juce::AudioBuffer<float> block(audio.getArrayOfWritePointers(), 2, pos, numSamples);
+
+                        if (mode == 2) morph->setValueNotifyingHost((float)pos / (float)totalSamples);
+
+                        const auto start = juce::Time::getHighResolutionTicks();
+                        processor.processBlock(block, midi);
+                        seconds += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+                    }
+
+                    best = std::min(best, seconds);
+                }
+
+                Result r;
+                r.name = "sceneMorph";
+                r.params.set("blockSize", blockSize);
+                r.params.set("scenes", modes[(size_t)mode]);
+                r.nsPerSample = best * 1.0e9 / totalSamples;
+                r.realtime = (totalSamples / sampleRate) / best;
+                suite.add(r);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h")) {
+        std::cout << "Usage: GranularFxBenchmarks [--quick] [--filter <text>] [--seconds <s>] [--repeats <n>] [--json <file>|-]" << std::endl;
+        return 0;
+    }
+
+    Options options;
+    options.quick = args.containsOption("--quick");
+    options.filter = args.getValueForOption("--filter");
+    if (args.containsOption("--seconds")) options.seconds = juce::jmax(0.1, args.getValueForOption("--seconds").getDoubleValue());
+    if (args.containsOption("--repeats")) options.repeats = juce::jmax(1, args.getValueForOption("--repeats").getIntValue());
+    if (options.quick && !args.containsOption("--seconds")) options.seconds = 0.5;
+
+    Suite suite(options);
+
+    benchmarkBufferReads(suite);
+    benchmarkStereoReads(suite);
+    benchmarkGrainPool(suite);
+    benchmarkParallelGrainPool(suite);
+    benchmarkGrainPoolLayouts(suite);
+    benchmarkFeedbackChain(suite);
+    benchmarkTanh(suite);
+    benchmarkProcessBlock(suite);
+    benchmarkSceneMorph(suite);
+
+    if (args.containsOption("--json")) {
+        if (args.getValueForOption("--json") == "-") {
+            std::cout << suite.toJson() << std::endl;
+        }
+        else {
+            auto file = args.getFileForOption("--json");
+
+            if (!file.replaceWithText(suite.toJson())) {
+                std::cerr << "Couldn't write " << file.getFullPathName() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return suite.hasFailed() ? 1 : 0;
+}
@@ -1,45 +1,329 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include "Interpolation.h"
+#include "SpeakerLayout.h"
 
 class CircularBuffer {
 public:
+    // Samples mirrored past the end of each channel, so interpolation taps never need to wrap
+    static constexpr int guardSamples = Interpolation::maxTaps;
+    static constexpr int maxChannels = SpeakerLayout::maxChannels;
+
+    // All take effect on the next respace
+    void setFormat(HistoryFormat newFormat) { format = newFormat; }
+    HistoryFormat getFormat() const { return format; }
+
+    // Interleaving only applies to stereo, other channel counts stay planar
+    void setLayout(HistoryLayout newLayout) { requestedLayout = newLayout; }
+    HistoryLayout getLayout() const { return layout; }
+
+    // At least two, mono runs as stereo
+    void setNumChannels(int channels) { requestedChannels = juce::jlimit(2, maxChannels, channels); }
+    int getNumChannels() const { return numChannels; }
+
+    // History bytes a respace to this many samples would hold with the settings above, the few guard
+    // samples aside
+    size_t getBytesFor(int samples) const {
+        const size_t sampleBytes = format == HistoryFormat::int16 ? sizeof(int16_t) : sizeof(float);
+        return (size_t)samples * (size_t)requestedChannels * sampleBytes;
+    }
+
+    size_t getBytes() const { return samplesFloat.size() * sizeof(float) + samplesCompact.size() * sizeof(int16_t); }
+
+    // Storage is allocated afresh, so a shorter buffer also gives the memory of a longer one back
     void respace(int samples) {
-        buffer.setSize(2, samples);
-        buffer.clear();
+        numChannels = requestedChannels;
+        layout = getEffectiveLayout();
+
+        const bool interleaved = layout == HistoryLayout::interleaved;
+        const int frames = getFramesFor(samples, layout);
+
+        stride = interleaved ? numChannels : 1;
+        channelOffset = interleaved ? 1 : frames;
+
+        if (format == HistoryFormat::int16) {
+            samplesFloat = {};
+            samplesCompact = std::vector<int16_t>((size_t)(frames * numChannels), 0);
+        }
+        else {
+            samplesCompact = {};
+            samplesFloat = std::vector<float>((size_t)(frames * numChannels), 0.0f);
+        }
 
         // Used for bitwise modulo logic, which is faster than fmod, but only works if buffer size is a power of 2
-        mask = samples - 1; 
+        mask = samples - 1;
+    }
+
+    // Takes over the history of a buffer with the same settings and at most this length, every sample
+    // keeping its distance behind writePos, which must be below the source's length. What lies further
+    // back than the source reached is silent. Never allocates, so the audio thread can switch to a longer
+    // buffer that was respaced for it elsewhere.
+    void copyHistory(const CircularBuffer& source, int writePos) {
+        jassert(format == source.format && layout == source.layout && numChannels == source.numChannels);
+        jassert(mask >= source.mask && writePos <= source.mask);
+
+        // Samples from the write position on are the oldest, they move to the end of this buffer
+        const int sourceSize = source.mask + 1;
+        const int shift = mask - source.mask;
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            if (format == HistoryFormat::int16) {
+                int16_t* dest = samplesCompact.data() + channel * channelOffset;
+                const int16_t* from = source.getCompactReadPointer(channel);
+
+                copyFrom(dest, from, 0, 0, writePos);
+                copyFrom(dest, from, writePos, writePos + shift, sourceSize - writePos);
+                copyRun(dest, 0, mask + 1, guardSamples);
+            }
+            else {
+                float* dest = samplesFloat.data() + channel * channelOffset;
+                const float* from = source.getReadPointer(channel);
+
+                copyFrom(dest, from, 0, 0, writePos);
+                copyFrom(dest, from, writePos, writePos + shift, sourceSize - writePos);
+                copyRun(dest, 0, mask + 1, guardSamples);
+            }
+        }
+
+        ditherState = source.ditherState;
     }
 
-    void write(float sampleL, float sampleR, int index) {
+    // One sample per channel
+    void write(const float* frame, int index) {
         int wrapped = index & mask;
-        buffer.setSample(0, wrapped, sampleL);
-        buffer.setSample(1, wrapped, sampleR);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            if (format == HistoryFormat::int16)
+                writeSample(samplesCompact.data() + channel * channelOffset, quantise(frame[channel], ditherState[(size_t)(channel & 3)]), wrapped);
+            else
+                writeSample(samplesFloat.data() + channel * channelOffset, frame[channel], wrapped);
+        }
     }
 
-    // Read from the buffer, lerp fractional indices
-    float read(int channel, float index) const {
-        int i1 = static_cast<int>(std::floor(index));
-        float frac = index - static_cast<float>(i1);
+    // Write numSamples consecutive frames of every channel starting at index, converting a whole run at a time
+    void writeSpan(const float* const* sources, int index, int numSamples) {
+        for (int done = 0; done < numSamples;) {
+            const int start = (index + done) & mask;
+            const int run = std::min(numSamples - done, mask + 1 - start);
+
+            // The guard mirrors stored samples, so int16 copies are never dithered twice
+            const int mirrored = juce::jlimit(0, run, guardSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const float* source = sources[channel] + done;
+
+                if (format == HistoryFormat::int16) {
+                    int16_t* dest = samplesCompact.data() + channel * channelOffset;
+
+                    if (stride == 1) {
+                        quantise(source, dest + start, run);
+                    }
+                    else {
+                        // Quantised in planar chunks so the dither sequence doesn't depend on the layout
+                        std::array<int16_t, quantiseChunk> chunk;
 
-        // Bitwise modulo
-        int idx1 = i1 & mask;
-        int idx2 = (i1 + 1) & mask;
+                        for (int i = 0; i < run; i += quantiseChunk) {
+                            const int n = std::min(quantiseChunk, run - i);
+                            quantise(source + i, chunk.data(), n);
+                            storeRun(dest, chunk.data(), start + i, n);
+                        }
+                    }
 
-        int ch = std::min(channel, buffer.getNumChannels() - 1);
+                    copyRun(dest, start, start + mask + 1, mirrored);
+                }
+                else {
+                    float* dest = samplesFloat.data() + channel * channelOffset;
+                    storeRun(dest, source, start, run);
+                    storeRun(dest, source, start + mask + 1, mirrored);
+                }
+            }
 
-        float s1 = buffer.getSample(ch, idx1);
-        float s2 = buffer.getSample(ch, idx2);
+            done += run;
+        }
+    }
+
+    // Read from the buffer at a fractional index with the given interpolation
+    float read(int channel, double index, InterpolationMode mode = InterpolationMode::linear, float pitchStep = 1.0f) const {
+        double i1 = std::floor(index);
+        float frac = (float)(index - i1);
+        int band = Interpolation::SincTables::getBand(pitchStep);
+
+        switch (mode) {
+            case InterpolationMode::hermite: return read<InterpolationMode::hermite>(channel, (int32_t)i1, frac, band);
+            case InterpolationMode::sinc:    return read<InterpolationMode::sinc>(channel, (int32_t)i1, frac, band);
+            case InterpolationMode::linear:
+            default:                         return read<InterpolationMode::linear>(channel, (int32_t)i1, frac, band);
+        }
+    }
 
-        return s1 + frac * (s2 - s1);
+    template <InterpolationMode mode>
+    float read(int channel, int32_t index, float frac, int band = 0) const {
+        if (format == HistoryFormat::int16) return readFrom<mode>(getCompactReadPointer(channel), index, frac, band);
+        return readFrom<mode>(getReadPointer(channel), index, frac, band);
     }
 
-    const juce::AudioBuffer<float>& getRawBuffer() const { return buffer; }
-    
+    // Both channels at the same position. With interleaved storage their taps come from the same cache lines.
+    template <InterpolationMode mode>
+    Interpolation::StereoSample readStereo(int32_t index, float frac, int band = 0) const {
+        if (layout == HistoryLayout::interleaved) {
+            if (format == HistoryFormat::int16) return Interpolation::readStereo<mode>(getCompactReadPointer(0), mask, index, frac, band);
+            return Interpolation::readStereo<mode>(getReadPointer(0), mask, index, frac, band);
+        }
+
+        return { read<mode>(0, index, frac, band), read<mode>(1, index, frac, band) };
+    }
+
+    // Raw access to one channel, consecutive samples of which are getStride() apart.
+    // Float storage only.
+    const float* getReadPointer(int channel) const { return samplesFloat.data() + channel * channelOffset; }
+
+    // Int16 storage only, full scale is 32768
+    const int16_t* getCompactReadPointer(int channel) const { return samplesCompact.data() + channel * channelOffset; }
+
+    // Either storage, for code that dispatches on getFormat itself
+    const void* getHistory(int channel) const {
+        if (format == HistoryFormat::int16) return getCompactReadPointer(channel);
+        return getReadPointer(channel);
+    }
+
+    int getStride() const { return stride; }
     int getMask() const { return mask; }
 
 private:
-    juce::AudioBuffer<float> buffer;
-    int mask;
-};
\ No newline at end of file
+    static constexpr int quantiseChunk = 64;
+
+    HistoryFormat format = HistoryFormat::float32;
+    HistoryLayout layout = HistoryLayout::planar;
+
+    HistoryLayout requestedLayout = HistoryLayout::planar;
+    int requestedChannels = 2;
+    int numChannels = 2;
+
+    // Planar channels follow each other, interleaved channels are offset by one sample
+    std::vector<float> samplesFloat;
+    std::vector<int16_t> samplesCompact;
+    int stride = 1;
+    int channelOffset = 0;
+    int mask = 0;
+
+    HistoryLayout getEffectiveLayout() const { return requestedChannels == 2 ? requestedLayout : HistoryLayout::planar; }
+
+    // Interleaved history carries one spare frame, the vector tap loads of the right channel reach
+    // half a frame past the guard
+    static int getFramesFor(int samples, HistoryLayout historyLayout) {
+        return samples + guardSamples + (historyLayout == HistoryLayout::interleaved ? 1 : 0);
+    }
+
+    template <InterpolationMode mode, typename Sample>
+    float readFrom(const Sample* history, int32_t index, float frac, int band) const {
+        if (stride == 2) return Interpolation::read<mode, 2>(history, mask, index, frac, band);
+        return Interpolation::read<mode>(history, mask, index, frac, band);
+    }
+
+    template <typename Sample>
+    void writeSample(Sample* channel, Sample sample, int wrapped) {
+        channel[wrapped * stride] = sample;
+
+        if (wrapped < guardSamples)
+            channel[(wrapped + mask + 1) * stride] = sample;
+    }
+
+    // Store numSamples of one channel from position start on
+    template <typename Sample>
+    void storeRun(Sample* channel, const Sample* source, int start, int numSamples) {
+        if (stride == 1) {
+            std::copy(source, source + numSamples, channel + start);
+            return;
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            channel[(start + i) * stride] = source[i];
+    }
+
+    template <typename Sample>
+    void copyRun(Sample* channel, int from, int to, int numSamples) {
+        for (int i = 0; i < numSamples; ++i)
+            channel[(to + i) * stride] = channel[(from + i) * stride];
+    }
+
+    // Same, from another buffer's channel with the same stride
+    template <typename Sample>
+    void copyFrom(Sample* channel, const Sample* source, int from, int to, int numSamples) {
+        if (stride == 1) {
+            std::copy(source + from, source + from + numSamples, channel + to);
+            return;
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            channel[(to + i) * stride] = source[(from + i) * stride];
+    }
+
+    // One xorshift generator per SIMD lane for the TPDF dither
+    alignas(16) std::array<uint32_t, 4> ditherState { 0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u };
+
+    static uint32_t nextDither(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // Triangular dither of one LSB peak from the difference of the generator's two halves
+    static int16_t quantise(float sample, uint32_t& state) {
+        const uint32_t r = nextDither(state);
+        const float dither = (float)((int32_t)(r >> 16) - (int32_t)(r & 0xffff)) * (1.0f / 65536.0f);
+        return (int16_t)juce::jlimit(-32768L, 32767L, std::lrint(sample * 32768.0f + dither));
+    }
+
+    void quantise(const float* source, int16_t* dest, int numSamples) {
+        int i = 0;
+
+       #if defined(INTERPOLATION_SSE)
+        __m128i state = _mm_load_si128((const __m128i*)ditherState.data());
+        const __m128i lowHalf = _mm_set1_epi32(0xffff);
+        const __m128 fullScale = _mm_set1_ps(32768.0f);
+        const __m128 ditherScale = _mm_set1_ps(1.0f / 65536.0f);
+
+        auto next = [&] {
+            state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+            state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+            state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+            __m128i tpdf = _mm_sub_epi32(_mm_srli_epi32(state, 16), _mm_and_si128(state, lowHalf));
+            return _mm_mul_ps(_mm_cvtepi32_ps(tpdf), ditherScale);
+        };
+
+        // Rounds to nearest, and the pack saturates anything past full scale
+        for (; i + 8 <= numSamples; i += 8) {
+            __m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i), fullScale), next());
+            __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 4), fullScale), next());
+            _mm_storeu_si128((__m128i*)(dest + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+        }
+
+        _mm_store_si128((__m128i*)ditherState.data(), state);
+       #elif defined(INTERPOLATION_NEON)
+        uint32x4_t state = vld1q_u32(ditherState.data());
+        const float32x4_t ditherScale = vdupq_n_f32(1.0f / 65536.0f);
+
+        auto next = [&] {
+            state = veorq_u32(state, vshlq_n_u32(state, 13));
+            state = veorq_u32(state, vshrq_n_u32(state, 17));
+            state = veorq_u32(state, vshlq_n_u32(state, 5));
+            int32x4_t tpdf = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(state, 16)),
+                                       vreinterpretq_s32_u32(vandq_u32(state, vdupq_n_u32(0xffff))));
+            return vmulq_f32(vcvtq_f32_s32(tpdf), ditherScale);
+        };
+
+        for (; i + 8 <= numSamples; i += 8) {
+            float32x4_t a = vmlaq_n_f32(next(), vld1q_f32(source + i), 32768.0f);
+            float32x4_t b = vmlaq_n_f32(next(), vld1q_f32(source + i + 4), 32768.0f);
+            vst1q_s16(dest + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+        }
+
+        vst1q_u32(ditherState.data(), state);
+       #endif
+
+        for (; i < numSamples; ++i)
+            dest[i] = quantise(source[i], ditherState[(size_t)(i & 3)]);
+    }
+};
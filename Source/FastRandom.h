@@ -0,0 +1,72 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <cstdint>
+
+// xoshiro128+ generator. Each processor owns one, so audio threads never share generator state and a
+// fixed seed reproduces the same sequence run to run.
+class FastRandom {
+public:
+    static constexpr int batchSize = 64;
+
+    explicit FastRandom(uint64_t seed = 1) {
+        setSeed(seed);
+    }
+
+    // Expand the seed with splitmix64, which also guarantees a non-zero state
+    void setSeed(uint64_t seed) {
+        for (int i = 0; i < 4; i += 2) {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z = z ^ (z >> 31);
+
+            state[i] = (uint32_t)z;
+            state[i + 1] = (uint32_t)(z >> 32);
+        }
+
+        batchPos = batchSize;
+    }
+
+    uint32_t nextUInt() {
+        const uint32_t result = state[0] + state[3];
+        const uint32_t t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = (state[3] << 11) | (state[3] >> 21);
+
+        return result;
+    }
+
+    // Uniform in [0, 1), built from the top 24 bits since the low bits of xoshiro128+ are weaker
+    float nextFloat() {
+        return (float)(nextUInt() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    void fillFloats(float* dest, int numValues) {
+        for (int i = 0; i < numValues; ++i)
+            dest[i] = nextFloat();
+    }
+
+    // Draw from a batch that is refilled batchSize values at a time. The sequence is identical to
+    // calling nextFloat directly, the generator just runs in tight bursts off the trigger path.
+    float nextBatchedFloat() {
+        if (batchPos >= batchSize) {
+            fillFloats(batch.data(), batchSize);
+            batchPos = 0;
+        }
+
+        return batch[batchPos++];
+    }
+
+private:
+    uint32_t state[4];
+
+    std::array<float, batchSize> batch;
+    int batchPos = batchSize;
+};
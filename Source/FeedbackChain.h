@@ -0,0 +1,220 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "SpeakerLayout.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #define FEEDBACK_CHAIN_SSE 1
+ #include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #define FEEDBACK_CHAIN_NEON 1
+ #include <arm_neon.h>
+#endif
+
+// Conditioning for the signal going back into the delay line: DC blocker, one-pole lowpass tone filter
+// and tanh saturation, a block at a time.
+//
+// The filters are recursive, so up to four channels run side by side as the lanes of one vector. Saturation
+// never feeds back into the filter state, which lets it run over the whole block afterwards, a full
+// vector of samples per instruction.
+class FeedbackChain {
+public:
+    static constexpr int maxChannels = SpeakerLayout::maxChannels;
+
+    // Largest error of fastTanh against std::tanh, over the whole float range
+    static constexpr float maxTanhError = 1.0e-6f;
+
+    void reset() {
+        hpfState.fill(0.0f);
+        lastInput.fill(0.0f);
+        toneState.fill(0.0f);
+    }
+
+    // Tone knob in [0, 1] mapped to a 200 Hz - 20 kHz cutoff. Calls std::exp, so only recompute on change.
+    static float getToneAlpha(float tone, double sampleRate) {
+        float toneHz = juce::jmap(tone, 200.0f, 20000.0f);
+        return 1.0f - std::exp(-2.0f * juce::MathConstants<float>::pi * toneHz / (float)sampleRate);
+    }
+
+    // Conditions numSamples of each channel in place
+    void process(float* const* channels, int numChannels, int numSamples, float toneAlpha) {
+        for (int first = 0; first < numChannels; first += groupSize)
+            filter(channels + first, std::min(groupSize, numChannels - first), first, numSamples, toneAlpha);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            saturate(channels[channel], numSamples);
+    }
+
+    //==============================================================================
+    // Rational minimax fit of tanh, odd degree 13 over even degree 6, the same one Eigen uses. Past
+    // the clamp tanh is 1 to within float precision, and near zero it is x.
+    static float fastTanh(float x) {
+        const float c = juce::jlimit(-tanhClamp, tanhClamp, x);
+        const float x2 = c * c;
+
+        float p = x2 * alpha[6] + alpha[5];
+        p = x2 * p + alpha[4];
+        p = x2 * p + alpha[3];
+        p = x2 * p + alpha[2];
+        p = x2 * p + alpha[1];
+        p = x2 * p + alpha[0];
+
+        float q = x2 * beta[3] + beta[2];
+        q = x2 * q + beta[1];
+        q = x2 * q + beta[0];
+
+        return std::abs(x) < tanhLinear ? x : c * p / q;
+    }
+
+    // fastTanh over a block in place
+    static void saturate(float* data, int numSamples) {
+        int i = 0;
+
+       #if defined(FEEDBACK_CHAIN_SSE)
+        const __m128 clamp = _mm_set1_ps(tanhClamp);
+        const __m128 linear = _mm_set1_ps(tanhLinear);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+        for (; i + 4 <= numSamples; i += 4) {
+            const __m128 x = _mm_loadu_ps(data + i);
+            const __m128 c = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), clamp), _mm_min_ps(clamp, x));
+            const __m128 x2 = _mm_mul_ps(c, c);
+
+            __m128 p = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(alpha[6])), _mm_set1_ps(alpha[5]));
+            p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(alpha[4]));
+            p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(alpha[3]));
+            p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(alpha[2]));
+            p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(alpha[1]));
+            p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(alpha[0]));
+
+            __m128 q = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(beta[3])), _mm_set1_ps(beta[2]));
+            q = _mm_add_ps(_mm_mul_ps(x2, q), _mm_set1_ps(beta[1]));
+            q = _mm_add_ps(_mm_mul_ps(x2, q), _mm_set1_ps(beta[0]));
+
+            const __m128 result = _mm_div_ps(_mm_mul_ps(c, p), q);
+            const __m128 small = _mm_cmplt_ps(_mm_and_ps(x, absMask), linear);
+            _mm_storeu_ps(data + i, _mm_or_ps(_mm_and_ps(small, x), _mm_andnot_ps(small, result)));
+        }
+       #elif defined(FEEDBACK_CHAIN_NEON)
+        for (; i + 4 <= numSamples; i += 4) {
+            const float32x4_t x = vld1q_f32(data + i);
+            const float32x4_t c = vmaxq_f32(vdupq_n_f32(-tanhClamp), vminq_f32(vdupq_n_f32(tanhClamp), x));
+            const float32x4_t x2 = vmulq_f32(c, c);
+
+            float32x4_t p = vaddq_f32(vmulq_n_f32(x2, alpha[6]), vdupq_n_f32(alpha[5]));
+            p = vaddq_f32(vmulq_f32(x2, p), vdupq_n_f32(alpha[4]));
+            p = vaddq_f32(vmulq_f32(x2, p), vdupq_n_f32(alpha[3]));
+            p = vaddq_f32(vmulq_f32(x2, p), vdupq_n_f32(alpha[2]));
+            p = vaddq_f32(vmulq_f32(x2, p), vdupq_n_f32(alpha[1]));
+            p = vaddq_f32(vmulq_f32(x2, p), vdupq_n_f32(alpha[0]));
+
+            float32x4_t q = vaddq_f32(vmulq_n_f32(x2, beta[3]), vdupq_n_f32(beta[2]));
+            q = vaddq_f32(vmulq_f32(x2, q), vdupq_n_f32(beta[1]));
+            q = vaddq_f32(vmulq_f32(x2, q), vdupq_n_f32(beta[0]));
+
+            const float32x4_t result = vdivq_f32(vmulq_f32(c, p), q);
+            vst1q_f32(data + i, vbslq_f32(vcltq_f32(vabsq_f32(x), vdupq_n_f32(tanhLinear)), x, result));
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+            data[i] = fastTanh(data[i]);
+    }
+
+private:
+    static constexpr float tanhClamp = 7.90531110763549805f;
+    static constexpr float tanhLinear = 0.0004f;
+
+    static constexpr float alpha[7] = { 4.89352455891786e-03f, 6.37261928875436e-04f, 1.48572235717979e-05f,
+                                        5.12229709037114e-08f, -8.60467152213735e-11f, 2.00018790482477e-13f,
+                                        -2.76076847742355e-16f };
+    static constexpr float beta[4] = { 4.89352518554385e-03f, 2.26843463243900e-03f, 1.18534705686654e-04f,
+                                       1.19825839466702e-06f };
+
+    // Channels per filter vector
+    static constexpr int groupSize = 4;
+
+    // Whole groups, so the vector paths can load and store state without masking
+    alignas(16) std::array<float, maxChannels> hpfState {};
+    alignas(16) std::array<float, maxChannels> lastInput {};
+    alignas(16) std::array<float, maxChannels> toneState {};
+
+    // DC blocker into the tone filter for up to groupSize channels, whose state starts at first. Lanes past
+    // numChannels filter a copy of the first channel: their state is written back with the group's but never
+    // read for output, and their output is discarded. Leaves the filter output in place.
+    void filter(float* const* channels, int numChannels, int first, int numSamples, float toneAlpha) {
+       #if defined(FEEDBACK_CHAIN_SSE) || defined(FEEDBACK_CHAIN_NEON)
+        std::array<float*, groupSize> lanes;
+        for (int lane = 0; lane < groupSize; ++lane)
+            lanes[(size_t)lane] = channels[lane < numChannels ? lane : 0];
+
+        alignas(16) float output[groupSize];
+       #endif
+
+       #if defined(FEEDBACK_CHAIN_SSE)
+        __m128 hpf = _mm_load_ps(hpfState.data() + first);
+        __m128 last = _mm_load_ps(lastInput.data() + first);
+        __m128 tone = _mm_load_ps(toneState.data() + first);
+        const __m128 decay = _mm_set1_ps(hpfDecay);
+        const __m128 a = _mm_set1_ps(toneAlpha);
+
+        for (int i = 0; i < numSamples; ++i) {
+            const __m128 input = _mm_setr_ps(lanes[0][i], lanes[1][i], lanes[2][i], lanes[3][i]);
+
+            hpf = _mm_mul_ps(decay, _mm_sub_ps(_mm_add_ps(hpf, input), last));
+            last = input;
+            tone = _mm_add_ps(tone, _mm_mul_ps(a, _mm_sub_ps(hpf, tone)));
+
+            _mm_store_ps(output, tone);
+            for (int lane = 0; lane < numChannels; ++lane)
+                channels[lane][i] = output[lane];
+        }
+
+        _mm_store_ps(hpfState.data() + first, hpf);
+        _mm_store_ps(lastInput.data() + first, last);
+        _mm_store_ps(toneState.data() + first, tone);
+       #elif defined(FEEDBACK_CHAIN_NEON)
+        float32x4_t hpf = vld1q_f32(hpfState.data() + first);
+        float32x4_t last = vld1q_f32(lastInput.data() + first);
+        float32x4_t tone = vld1q_f32(toneState.data() + first);
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float input[groupSize] = { lanes[0][i], lanes[1][i], lanes[2][i], lanes[3][i] };
+            const float32x4_t x = vld1q_f32(input);
+
+            hpf = vmulq_n_f32(vsubq_f32(vaddq_f32(hpf, x), last), hpfDecay);
+            last = x;
+            tone = vaddq_f32(tone, vmulq_n_f32(vsubq_f32(hpf, tone), toneAlpha));
+
+            vst1q_f32(output, tone);
+            for (int lane = 0; lane < numChannels; ++lane)
+                channels[lane][i] = output[lane];
+        }
+
+        vst1q_f32(hpfState.data() + first, hpf);
+        vst1q_f32(lastInput.data() + first, last);
+        vst1q_f32(toneState.data() + first, tone);
+       #else
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const size_t state = (size_t)(first + channel);
+            float* data = channels[channel];
+            float hpf = hpfState[state];
+            float last = lastInput[state];
+            float tone = toneState[state];
+
+            for (int i = 0; i < numSamples; ++i) {
+                hpf = hpfDecay * (hpf + data[i] - last);
+                last = data[i];
+                tone += toneAlpha * (hpf - tone);
+                data[i] = tone;
+            }
+
+            hpfState[state] = hpf;
+            lastInput[state] = last;
+            toneState[state] = tone;
+        }
+       #endif
+    }
+
+    static constexpr float hpfDecay = 0.997f;
+};
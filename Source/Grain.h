@@ -1,154 +1,782 @@
 #pragma once
 
 #include "CircularBuffer.h"
+#include "GrainEvents.h"
+#include "GrainKernels.h"
+#include "GrainRenderWorkers.h"
+#include "WindowTable.h"
 #include <juce_audio_processors/juce_audio_processors.h>
 
-struct GrainChannel {
-    double readPos = 0.0;
-    double pitchStep = 0.0;
-    int totalSamples = 0;
-    int samplesProcessed = 0;
-
-    // Debug
-    double actualSamplesRead = 0.0;
-
-    void reset(int durationSamples, double startReadPos, double step) {
-        totalSamples = durationSamples;
-        readPos = startReadPos;
-        pitchStep = step;
-        samplesProcessed = 0;
-        actualSamplesRead = 0.0;
-    }
-
-    // Calculate and set the output level for this channel, return false when the channel is finished playing
-    bool getNextSample(
-        const CircularBuffer& buffer, 
-        int channelIndex, 
-        float& outputSample, 
-        bool reverse, 
-        int writePos = 0, 
-        int mask = 0, 
-        // Debug params
-        std::atomic<bool>* collisionFlag = nullptr, 
-        std::atomic<float>* collisionSamples = nullptr, 
-        float* debugCollisionPos = nullptr, 
-        int* debugWritePosCol = nullptr
+// Debug state for the event log, kept apart from the hot lanes so rendering never pulls it through the cache.
+// Only allocated when GrainEvents::enabled.
+struct GrainDebugInfo {
+    double expectedSamplesFirst = 0.0;
+    double expectedSamplesLast = 0.0;
+    bool collision = false;
+};
+
+// Structure-of-arrays grain store. Each read head of the speaker layout keeps its positions, steps and
+// envelope progress, and each channel its gains, in separate aligned arrays, so the span kernels can
+// advance several grains per instruction. A head renders all the channels on its side in one pass.
+// Envelopes are read from the shared WindowTables, each grain keeping the shape it was triggered with.
+//
+// Live grains are kept packed in slots [0, numActive): a new grain takes the first free slot and a
+// finished one is replaced by the last live grain, so both are O(1) and rendering never walks past the
+// live set. When the pool is full the steal policy picks a grain to make room instead of dropping the new
+// one. The victim isn't cut off but fades out over stealFadeSamples from a few slots held in reserve past
+// the capacity. Live grains are also linked in trigger order, so the oldest is found without a search.
+class GrainPool {
+public:
+    static constexpr int defaultCapacity = 32;
+    static constexpr int maxCapacity = 4096;
+    static constexpr int maxHeads = SpeakerLayout::maxHeads;
+    static constexpr int maxChannels = SpeakerLayout::maxChannels;
+    static constexpr int maxSpanSamples = 64;
+
+    // Stolen grains fade out over this many samples, up to fadingSlots of them at once. Past that the
+    // oldest fading grain is cut off, by then it's already partly faded.
+    static constexpr int stealFadeSamples = 128;
+    static constexpr int fadingSlots = 16;
+
+    // Parallel rendering hands out chunks of this many lanes, and only kicks in from parallelMinGrains
+    // live grains, below that waking the helpers costs more than it saves
+    static constexpr int chunkLanes = 64;
+    static constexpr int parallelMinGrains = 2 * chunkLanes;
+
+    enum class StealPolicy {
+        oldest = 0,
+        quietest
+    };
+
+    static juce::StringArray getStealPolicyNames() {
+        return { "Oldest", "Quietest" };
+    }
+
+    // Where and how fast one head of a new grain reads
+    struct HeadParams {
+        int durationSamples = 0;
+        double delaySamples = 0.0;
+        double step = 1.0;
+    };
+
+    GrainPool() : windows(WindowTables::getInstance().getData()) {
+        // Sinc tables are built here so the audio thread never pays for it
+        Interpolation::SincTables::getInstance();
+
+        for (int format = 0; format < (int)HistoryFormat::numFormats; ++format)
+            for (int layout = 0; layout < (int)HistoryLayout::numLayouts; ++layout)
+                for (int mode = 0; mode < (int)InterpolationMode::numModes; ++mode)
+                    for (const bool singleChannel : { false, true })
+                        spanKernels[(size_t)format][(size_t)layout][(size_t)mode][(size_t)singleChannel]
+                            = GrainKernels::selectSpanKernel((InterpolationMode)mode, (HistoryFormat)format,
+                                                             (HistoryLayout)layout, singleChannel);
+
+        capacity = defaultCapacity;
+        allocate();
+    }
+
+    // Allocates, so call from prepareToPlay or the message thread. Rounded up to whole SIMD lanes.
+    void setCapacity(int newCapacity) {
+        constexpr int width = GrainKernels::maxLaneWidth;
+        newCapacity = (juce::jlimit(width, maxCapacity, newCapacity) + width - 1) / width * width;
+
+        if (newCapacity == capacity) return;
+        capacity = newCapacity;
+        allocate();
+    }
+
+    // Heads and channels to render, allocates like setCapacity. Drops every live grain.
+    void setLayout(const SpeakerLayout& newLayout) {
+        layout = newLayout;
+        allocate();
+    }
+
+    const SpeakerLayout& getLayout() const { return layout; }
+
+    void reset() {
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            auto& lanes = heads[(size_t)head];
+            lanes.readIndex.fill(0);
+            lanes.readFrac.fill(0.0f);
+            lanes.step.fill(0.0f);
+            lanes.processed.fill(0);
+            lanes.total.fill(0);
+            lanes.envScale.fill(0.0f);
+        }
+
+        for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+            gains[(size_t)channel].fill(0.0f);
+
+        startOffset.fill(0);
+        windowOffset.fill(0);
+        std::fill(triggerOrder.begin(), triggerOrder.end(), 0u);
+        std::fill(isReverse.begin(), isReverse.end(), false);
+        std::fill(isFading.begin(), isFading.end(), false);
+        std::fill(debug.begin(), debug.end(), GrainDebugInfo {});
+
+        numActive = 0;
+        numFading = 0;
+        triggerCount = 0;
+        sounding = {};
+        fading = {};
+    }
+
+    // Moves every live grain's read position into a history buffer of a new length that took over the
+    // old one's samples at the same distance behind writePos. A grain up to maxBehind behind the write
+    // head stays behind it, one further back than that is ahead of it.
+    void rebase(int writePos, int oldSize, int maxBehind) {
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            auto& readIndex = heads[(size_t)head].readIndex;
+
+            for (int slot = 0; slot < numActive; ++slot) {
+                const int behind = (writePos - readIndex[slot]) & (oldSize - 1);
+                readIndex[slot] = behind <= maxBehind ? writePos - behind : writePos + oldSize - behind;
+            }
+        }
+    }
+
+    void setStealPolicy(StealPolicy policy) { stealPolicy = policy; }
+
+    // Optional helper threads, used for spans with at least parallelMinGrains live grains. Allocates
+    // scratch for each of their threads, so call once they are started, from prepareToPlay or the message
+    // thread. Drops every live grain.
+    void setWorkers(GrainRenderWorkers* newWorkers) {
+        workers = newWorkers;
+        allocate();
+    }
+
+    // Lifecycle events go here when built with GrainEvents::enabled, ignored otherwise
+    void setEventLog(GrainEventLog* newEventLog) { eventLog = newEventLog; }
+
+    // These parameters are assumed to be safe; a minimum safe delay must be calculated and enforced beforehand.
+    // headParams holds one entry per layout head, channelGains one per layout channel.
+    // Returns false when the pool was full and another grain was stolen to make room.
+    bool trigger(
+        int writePos,
+        const HeadParams* headParams,
+        const float* channelGains,
+        bool reverse,
+        int windowShape,
+        int spanOffset = 0
     ) {
-        if (samplesProcessed >= totalSamples) {
-            outputSample = 0.0f;
-            return false;
+        const bool stealing = numActive - numFading == capacity;
+
+        if (stealing) {
+            const int victim = findStealVictim();
+
+            if constexpr (GrainEvents::enabled) {
+                pushEvent(GrainEvent::Type::steal, victim, writePos,
+                    { (float)heads[0].processed[victim], (float)heads[0].total[victim] });
+            }
+
+            fadeOut(victim);
+        }
+
+        int slot = numActive;
+
+        if (numActive < numSlots) ++numActive;
+        else {
+            // Every reserve slot is fading already, the oldest of them makes way
+            slot = fading.first;
+            unlink(fading, slot);
+            isFading[(size_t)slot] = false;
+            --numFading;
+        }
+
+        append(sounding, slot);
+
+        const float direction = reverse ? -1.0f : 1.0f;
+        const int lastHead = layout.getNumHeads() - 1;
+
+        for (int head = 0; head <= lastHead; ++head) {
+            const auto& params = headParams[head];
+            setHead(head, slot, params.durationSamples, (double)writePos - params.delaySamples, (float)params.step * direction);
+        }
+
+        for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+            gains[(size_t)channel][slot] = channelGains[channel];
+
+        startOffset[slot] = spanOffset;
+        windowOffset[slot] = WindowTables::getOffset(windowShape);
+        triggerOrder[(size_t)slot] = triggerCount++;
+        isReverse[(size_t)slot] = reverse;
+
+        if constexpr (GrainEvents::enabled) {
+            auto& info = debug[(size_t)slot];
+            info = {};
+            info.expectedSamplesFirst = (double)headParams[0].durationSamples * std::abs(headParams[0].step);
+            info.expectedSamplesLast = (double)headParams[lastHead].durationSamples * std::abs(headParams[lastHead].step);
+
+            pushEvent(GrainEvent::Type::trigger, slot, writePos,
+                { (float)headParams[0].durationSamples, (float)headParams[0].delaySamples, (float)headParams[lastHead].delaySamples,
+                  (float)headParams[lastHead].step });
+        }
+
+        return !stealing;
+    }
+
+    // Accumulate every active grain's contribution to a render span of numSamples, starting at the span's writePos.
+    // out holds one span per layout channel, LFE channels are left untouched.
+    void renderSpan(const CircularBuffer& buffer, float* const* out, int numSamples, int writePos,
+        int mask, InterpolationMode interpolation, std::atomic<bool>* collisionFlag, std::atomic<float>* collisionSamples
+    ) {
+        // Read and write heads both move linearly over the span, so their distance peaks at one of the ends.
+        // The right-most head has the shortest delay.
+        if (collisionFlag != nullptr || (GrainEvents::enabled && eventLog != nullptr)) {
+            const int lastHead = layout.getNumHeads() - 1;
+            const auto& lanes = heads[(size_t)lastHead];
+
+            for (int slot = 0; slot < numActive; ++slot) {
+                const int spanSamples = std::min(numSamples - startOffset[slot], lanes.total[slot] - lanes.processed[slot]);
+                if (spanSamples <= 0) continue;
+
+                const double pos = getReadPosition(lastHead, slot);
+                const int spanWritePos = writePos + startOffset[slot];
+
+                checkCollision(slot, pos, spanWritePos, mask, collisionFlag, collisionSamples);
+                checkCollision(slot, pos + (double)lanes.step[slot] * (spanSamples - 1), spanWritePos + spanSamples - 1,
+                               mask, collisionFlag, collisionSamples);
+            }
+        }
+
+        // Kernels work in whole vectors, lanes past numActive are cleared on release so they never contribute.
+        // Lanes are rendered chunk by chunk and the chunks summed in order whether or not helpers are used,
+        // so the output doesn't depend on the thread count.
+        constexpr int width = GrainKernels::maxLaneWidth;
+        const int numLanes = (numActive + width - 1) / width * width;
+        const int numChunks = (numLanes + chunkLanes - 1) / chunkLanes;
+
+        const auto& kernels = spanKernels[(size_t)buffer.getFormat()][(size_t)buffer.getLayout()][(size_t)interpolation];
+        SpanJob job { {}, {}, mask, numSamples, numLanes };
+        for (int head = 0; head < layout.getNumHeads(); ++head)
+            job.kernels[(size_t)head] = kernels[(size_t)(layout.getHead(head).numChannels == 1)];
+        for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+            job.history[(size_t)channel] = buffer.getHistory(channel);
+
+        JobSlot* slot = nullptr;
+        if (workers != nullptr && workers->isBlockActive() && numActive >= parallelMinGrains
+            && workers->getNumWorkers() + 1 == numExecutors) {
+            for (auto& candidate : jobSlots)
+                if (!workers->isInUse(&candidate)) {
+                    slot = &candidate;
+                    break;
+                }
+        }
+
+        if (slot != nullptr) {
+            fillJobSlot(*slot, job);
+            workers->run(numChunks, renderChunkJob, slot);
+
+            // Each chunk's lane state and output come from whichever thread's result run settled on
+            for (int chunk = 0; chunk < numChunks; ++chunk) {
+                const int executor = workers->getExecutor(chunk);
+                const int firstLane = chunk * chunkLanes;
+                const int chunkSize = std::min(chunkLanes, numLanes - firstLane);
+
+                for (int head = 0; head < layout.getNumHeads(); ++head) {
+                    const auto lanes = getLanes(head, firstLane);
+                    const auto result = getChunkLanes(*slot, executor, chunk, head);
+                    std::copy(result.readIndex, result.readIndex + chunkSize, lanes.readIndex);
+                    std::copy(result.readFrac, result.readFrac + chunkSize, lanes.readFrac);
+                    std::copy(result.processed, result.processed + chunkSize, lanes.processed);
+
+                    for (const int channel : layout.getHead(head))
+                        juce::FloatVectorOperations::add(out[channel], getChunkOut(executor, chunk, channel), numSamples);
+                }
+            }
+        }
+        else {
+            for (int chunk = 0; chunk < numChunks; ++chunk) {
+                const int firstLane = chunk * chunkLanes;
+
+                for (int head = 0; head < layout.getNumHeads(); ++head)
+                    renderChunk(job, getLanes(head, firstLane), gains, head, firstLane, std::min(chunkLanes, numLanes - firstLane),
+                                laneAccum.data(), out);
+            }
+        }
+
+        for (int slot = 0; slot < numActive;) {
+            startOffset[slot] = 0;
+
+            // The last live grain moves into a released slot, so the same slot is looked at again
+            if (isFinished(slot)) {
+                // Stolen grains already logged their steal and don't finish as planned
+                if constexpr (GrainEvents::enabled) {
+                    if (!isFading[(size_t)slot]) {
+                        const int lastHead = layout.getNumHeads() - 1;
+                        const auto& info = debug[(size_t)slot];
+                        pushEvent(GrainEvent::Type::finish, slot, writePos + numSamples,
+                            { (float)info.expectedSamplesFirst, (float)getActualSamplesRead(0, slot),
+                              (float)info.expectedSamplesLast, (float)getActualSamplesRead(lastHead, slot) });
+                    }
+                }
+
+                release(slot);
+            }
+            else ++slot;
+        }
+    }
+
+    //==============================================================================
+    // Live grains, fading ones included, are always slots [0, getNumActive())
+    int getCapacity() const { return capacity; }
+    int getNumActive() const { return numActive; }
+    bool isSlotActive(int slot) const { return slot < numActive; }
+    bool isSlotReverse(int slot) const { return isReverse[(size_t)slot]; }
+
+    // Per read head, in layout order from left to right
+    int getNumHeads() const { return layout.getNumHeads(); }
+
+    double getReadPosition(int head, int slot) const {
+        return (double)heads[(size_t)head].readIndex[slot] + (double)heads[(size_t)head].readFrac[slot];
+    }
+
+    float getPitchStep(int head, int slot) const { return std::abs(heads[(size_t)head].step[slot]); }
+    int getTotalSamples(int head, int slot) const { return heads[(size_t)head].total[slot]; }
+    int getSamplesProcessed(int head, int slot) const { return heads[(size_t)head].processed[slot]; }
+
+    double getActualSamplesRead(int head, int slot) const {
+        return (double)heads[(size_t)head].processed[slot] * std::abs(heads[(size_t)head].step[slot]);
+    }
+
+private:
+    // Heap array aligned for whole-vector loads, only resized from setCapacity
+    template <typename T>
+    class LaneArray {
+    public:
+        void resize(int size) {
+            constexpr size_t alignment = 32;
+            storage.assign((size_t)size + alignment / sizeof(T), T {});
+            offset = (alignment - reinterpret_cast<std::uintptr_t>(storage.data()) % alignment) % alignment / sizeof(T);
+            length = size;
+        }
+
+        void fill(T value) { std::fill(data(), data() + length, value); }
+
+        T* data() { return storage.data() + offset; }
+        const T* data() const { return storage.data() + offset; }
+
+        T& operator[](int i) { return data()[i]; }
+        const T& operator[](int i) const { return data()[i]; }
+
+    private:
+        std::vector<T> storage;
+        size_t offset = 0;
+        int length = 0;
+    };
+
+    struct HeadLanes {
+        LaneArray<int32_t> readIndex;
+        LaneArray<float> readFrac;
+        LaneArray<float> step;
+        LaneArray<int32_t> processed;
+        LaneArray<int32_t> total;
+        LaneArray<float> envScale;
+    };
+
+    SpeakerLayout layout;
+    int capacity = 0;
+    int numSlots = 0; // Capacity plus the fading reserve
+    int numActive = 0;
+    int numFading = 0;
+
+    std::array<HeadLanes, maxHeads> heads;
+    std::array<LaneArray<float>, maxChannels> gains;
+    LaneArray<int32_t> startOffset;
+    LaneArray<int32_t> windowOffset;
+    LaneArray<float> laneAccum;
+
+    // Scratch for parallel spans. Every thread that can run a chunk, the audio thread and each helper,
+    // has its own accumulator and, per chunk, its own copy of the lane state the kernels advance and its
+    // own output. A helper that runs late may still be writing its copies after the span has moved on,
+    // and no one else ever touches them. Only allocated with helpers.
+    int numExecutors = 0;
+    int maxChunks = 0;
+    LaneArray<int32_t> chunkReadIndex;
+    LaneArray<float> chunkReadFrac;
+    LaneArray<int32_t> chunkProcessed;
+    LaneArray<float> chunkOut;
+    LaneArray<float> executorAccum;
+
+    struct SpanJob {
+        std::array<GrainSpanKernel, maxHeads> kernels {};
+        std::array<const void*, maxChannels> history {};
+        int mask = 0;
+        int numSamples = 0;
+        int numLanes = 0;
+    };
+
+    // What the chunks of a parallel span read: the job and a copy of the lanes it starts from. A late
+    // helper may still be reading a slot after its span is over, so a slot is only refilled once the
+    // workers say no helper is in it, and a span with every slot in use renders on the audio thread.
+    struct JobSlot {
+        GrainPool* pool = nullptr;
+        SpanJob job;
+        std::array<HeadLanes, maxHeads> heads;
+        std::array<LaneArray<float>, maxChannels> gains;
+        LaneArray<int32_t> startOffset;
+        LaneArray<int32_t> windowOffset;
+    };
+
+    static constexpr int numJobSlots = 2;
+    std::array<JobSlot, numJobSlots> jobSlots;
+    GrainRenderWorkers* workers = nullptr;
+
+    // Cold per-grain state, only touched on trigger, release and steal
+    std::vector<uint32_t> triggerOrder;
+    std::vector<bool> isReverse;
+    std::vector<bool> isFading;
+    uint32_t triggerCount = 0;
+    StealPolicy stealPolicy = StealPolicy::oldest;
+
+    // Doubly linked lists through the slots in trigger order, one for sounding grains and one for fading
+    // ones, so the first of each is its oldest. Links follow a grain when release moves it.
+    struct OrderList {
+        int first = -1;
+        int last = -1;
+    };
+
+    OrderList sounding;
+    OrderList fading;
+    std::vector<int> orderPrev;
+    std::vector<int> orderNext;
+
+    // Only sized when GrainEvents::enabled
+    std::vector<GrainDebugInfo> debug;
+    GrainEventLog* eventLog = nullptr;
+
+    const float* windows;
+    // Indexed by whether a head renders a single channel
+    using ChannelKernels = std::array<GrainSpanKernel, 2>;
+    using ModeKernels = std::array<ChannelKernels, (size_t)InterpolationMode::numModes>;
+    std::array<std::array<ModeKernels, (size_t)HistoryLayout::numLayouts>, (size_t)HistoryFormat::numFormats> spanKernels;
+
+    void allocate() {
+        numSlots = capacity + fadingSlots;
+
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            auto& lanes = heads[(size_t)head];
+            lanes.readIndex.resize(numSlots);
+            lanes.readFrac.resize(numSlots);
+            lanes.step.resize(numSlots);
+            lanes.processed.resize(numSlots);
+            lanes.total.resize(numSlots);
+            lanes.envScale.resize(numSlots);
         }
 
-        // Debug
-        if (collisionFlag != nullptr) {
-            int size = mask + 1;
-            int rInt = static_cast<int>(std::floor(readPos));
-            int wrappedDist = (rInt - writePos) & mask;
+        for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+            gains[(size_t)channel].resize(numSlots);
+
+        startOffset.resize(numSlots);
+        windowOffset.resize(numSlots);
+
+        laneAccum.resize(getAccumSize());
+
+        const int numWorkers = workers != nullptr ? workers->getNumWorkers() : 0;
+        numExecutors = numWorkers > 0 ? numWorkers + 1 : 0;
+        maxChunks = numSlots / chunkLanes + 1;
+
+        const int chunkLaneCount = numExecutors * maxChunks * layout.getNumHeads() * chunkLanes;
+        chunkReadIndex.resize(chunkLaneCount);
+        chunkReadFrac.resize(chunkLaneCount);
+        chunkProcessed.resize(chunkLaneCount);
+        chunkOut.resize(numExecutors * maxChunks * layout.getNumChannels() * maxSpanSamples);
+        executorAccum.resize(numExecutors * getAccumSize());
 
-            if (wrappedDist > (size / 2)) { wrappedDist -= size; }
+        for (auto& slot : jobSlots) {
+            const int slotLanes = numExecutors > 0 ? numSlots : 0;
+            slot.pool = this;
 
-            if (wrappedDist > 0) {
-                *collisionFlag = true;
-                if (collisionSamples) *collisionSamples = (float)wrappedDist;
-                if (debugCollisionPos) *debugCollisionPos = (float)wrappedDist;
-                if (debugWritePosCol) *debugWritePosCol = writePos;
+            for (int head = 0; head < layout.getNumHeads(); ++head) {
+                auto& lanes = slot.heads[(size_t)head];
+                lanes.readIndex.resize(slotLanes);
+                lanes.readFrac.resize(slotLanes);
+                lanes.step.resize(slotLanes);
+                lanes.processed.resize(slotLanes);
+                lanes.total.resize(slotLanes);
+                lanes.envScale.resize(slotLanes);
             }
+
+            for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+                slot.gains[(size_t)channel].resize(slotLanes);
+
+            slot.startOffset.resize(slotLanes);
+            slot.windowOffset.resize(slotLanes);
         }
 
-        // Calculate hanning window
-        float envIndex = (float)samplesProcessed / (float)totalSamples;
-        float window = 0.5f * (1.0f - std::cos(2.0f * juce::MathConstants<float>::pi * envIndex));
+        triggerOrder.resize((size_t)numSlots);
+        isReverse.resize((size_t)numSlots);
+        isFading.resize((size_t)numSlots);
+        orderPrev.resize((size_t)numSlots);
+        orderNext.resize((size_t)numSlots);
+        if constexpr (GrainEvents::enabled) debug.resize((size_t)numSlots);
+
+        reset();
+    }
 
-        // Read from buffer and advance
-        outputSample = buffer.read(channelIndex, readPos) * window;
-        
-        float direction = reverse ? -1.0f : 1.0f;
-        readPos += pitchStep * direction;
-        
-        samplesProcessed++;
+    void setHead(int head, int slot, int durationSamples, double startReadPos, float step) {
+        auto& lanes = heads[(size_t)head];
+        const double startIndex = std::floor(startReadPos);
 
-        actualSamplesRead += std::abs(pitchStep);
+        lanes.readIndex[slot] = (int32_t)startIndex;
+        lanes.readFrac[slot] = (float)(startReadPos - startIndex);
+        lanes.step[slot] = step;
+        lanes.processed[slot] = 0;
+        lanes.total[slot] = durationSamples;
+        lanes.envScale[slot] = durationSamples > 0 ? (float)WindowTables::tableSize / (float)durationSamples : 0.0f;
+    }
 
+    bool isFinished(int slot) const {
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            if (heads[(size_t)head].processed[slot] < heads[(size_t)head].total[slot]) return false;
+        }
         return true;
     }
-};
 
-struct Grain {
-    GrainChannel chL;
-    GrainChannel chR;
-
-    float leftGain = 0.707f;
-    float rightGain = 0.707f;
-    bool isReverse = false;
-    bool isActive = false;
-
-    // Debug 
-    int startBufferSample = 0;
-    double expectedSamplesL = 0.0;
-    double expectedSamplesR = 0.0;
-    float initFinalBaseDelay = 0.0f;
-    double initReadPosR = 0.0;
-    int initWritePos = 0;
-    
-    // Debug
-    bool collision = false;
-    float cs = 0.0f;
-    int writePosAtCollision = 0;
-
-    // Debug
-    double getActualSamplesReadL() const { return chL.actualSamplesRead; }
-    double getActualSamplesReadR() const { return chR.actualSamplesRead; }
-
-    // These parameters are assumed to be safe; a minimum safe delay must be calculated and enforced beforehand
-    void trigger(
-        int writePos, 
-        int durSamplesL, int durSamplesR,
-        double delaySamplesL, double delaySamplesR,
-        double stepL, double stepR,
-        float gainL, float gainR,
-        bool reverse
-    ) {
-        chL.reset(durSamplesL, (double)writePos - delaySamplesL, stepL);
-        chR.reset(durSamplesR, (double)writePos - delaySamplesR, stepR);
+    // Move the last live grain into slot and clear the lane it leaves behind
+    void release(int slot) {
+        if (isFading[(size_t)slot]) --numFading;
+        unlink(isFading[(size_t)slot] ? fading : sounding, slot);
+
+        const int last = --numActive;
+
+        if (slot != last) {
+            relink(isFading[(size_t)last] ? fading : sounding, last, slot);
+
+            for (int head = 0; head < layout.getNumHeads(); ++head) {
+                auto& lanes = heads[(size_t)head];
+                lanes.readIndex[slot] = lanes.readIndex[last];
+                lanes.readFrac[slot] = lanes.readFrac[last];
+                lanes.step[slot] = lanes.step[last];
+                lanes.processed[slot] = lanes.processed[last];
+                lanes.total[slot] = lanes.total[last];
+                lanes.envScale[slot] = lanes.envScale[last];
+            }
+
+            for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+                gains[(size_t)channel][slot] = gains[(size_t)channel][last];
+
+            startOffset[slot] = startOffset[last];
+            windowOffset[slot] = windowOffset[last];
+            triggerOrder[(size_t)slot] = triggerOrder[(size_t)last];
+            isReverse[(size_t)slot] = isReverse[(size_t)last];
+            isFading[(size_t)slot] = isFading[(size_t)last];
+            if constexpr (GrainEvents::enabled) debug[(size_t)slot] = debug[(size_t)last];
+        }
 
-        leftGain = gainL;
-        rightGain = gainR;
-        
-        isReverse = reverse;
-        isActive = true;
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            heads[(size_t)head].processed[last] = 0;
+            heads[(size_t)head].total[last] = 0;
+        }
 
-        // Debug 
-        startBufferSample = writePos;
-        expectedSamplesL = (double)chL.totalSamples * std::abs(stepL);
-        expectedSamplesR = (double)chR.totalSamples * std::abs(stepR);
-        initWritePos = writePos;
-        collision = false;
+        startOffset[last] = 0;
+        isFading[(size_t)last] = false;
     }
 
-    void process(const CircularBuffer& buffer, float& outL, float& outR, int writePos, 
-        int mask, std::atomic<bool>* collisionFlag, std::atomic<float>* collisionSamples
-    ) {
-        if (!isActive) {
-            outL = 0.0f; outR = 0.0f; return;
+    // Restart every head of slot on the release table, from the level its envelope is at now, so it
+    // carries on reading where it is and reaches silence stealFadeSamples later
+    void fadeOut(int slot) {
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            auto& lanes = heads[(size_t)head];
+            const bool playing = lanes.processed[slot] < lanes.total[slot];
+            const int phase = (int)((float)lanes.processed[slot] * lanes.envScale[slot]);
+            const float level = playing ? windows[windowOffset[slot] + phase] : 0.0f;
+
+            for (const int channel : layout.getHead(head))
+                gains[(size_t)channel][slot] *= level;
+
+            lanes.processed[slot] = 0;
+            lanes.total[slot] = playing ? stealFadeSamples : 0;
+            lanes.envScale[slot] = (float)WindowTables::tableSize / (float)stealFadeSamples;
         }
 
-        float sampleL = 0.0f;
-        float sampleR = 0.0f;
+        windowOffset[slot] = WindowTables::releaseOffset;
+
+        unlink(sounding, slot);
+        append(fading, slot);
+        isFading[(size_t)slot] = true;
+        ++numFading;
+    }
+
+    void append(OrderList& list, int slot) {
+        orderPrev[(size_t)slot] = list.last;
+        orderNext[(size_t)slot] = -1;
+        (list.last >= 0 ? orderNext[(size_t)list.last] : list.first) = slot;
+        list.last = slot;
+    }
+
+    void unlink(OrderList& list, int slot) {
+        const int prev = orderPrev[(size_t)slot];
+        const int next = orderNext[(size_t)slot];
+        (prev >= 0 ? orderNext[(size_t)prev] : list.first) = next;
+        (next >= 0 ? orderPrev[(size_t)next] : list.last) = prev;
+    }
+
+    // The grain in slot from now lives in slot to
+    void relink(OrderList& list, int from, int to) {
+        const int prev = orderPrev[(size_t)from];
+        const int next = orderNext[(size_t)from];
+        orderPrev[(size_t)to] = prev;
+        orderNext[(size_t)to] = next;
+        (prev >= 0 ? orderNext[(size_t)prev] : list.first) = to;
+        (next >= 0 ? orderPrev[(size_t)next] : list.last) = to;
+    }
+
+    // Only ever reached with the pool full. Oldest is the head of the trigger order list, quietest has to
+    // look at every sounding grain.
+    int findStealVictim() const {
+        if (stealPolicy != StealPolicy::quietest) return sounding.first;
 
-        bool activeL = chL.getNextSample(buffer, 0, sampleL, isReverse);
+        int victim = sounding.first;
+        float quietest = std::numeric_limits<float>::max();
 
-        bool activeR = chR.getNextSample(buffer, 1, sampleR, isReverse, 
-                                         writePos, mask, 
-                                         collisionFlag, collisionSamples, 
-                                         &cs, &writePosAtCollision);
-        
-        if (cs > 0.0f) collision = true; // Debug
+        for (int slot = 0; slot < numActive; ++slot) {
+            if (isFading[(size_t)slot]) continue;
 
-        outL = sampleL * leftGain;
-        outR = sampleR * rightGain;
+            float level = 0.0f;
 
-        if (!activeL && !activeR) {
-            isActive = false;
+            for (int head = 0; head < layout.getNumHeads(); ++head) {
+                const auto& lanes = heads[(size_t)head];
+                const int phase = (int)((float)lanes.processed[slot] * lanes.envScale[slot]);
+                const float window = windows[windowOffset[slot] + phase];
+
+                for (const int channel : layout.getHead(head))
+                    level = std::max(level, window * gains[(size_t)channel][slot]);
+            }
+
+            if (level < quietest) {
+                quietest = level;
+                victim = slot;
+            }
+        }
+
+        return victim;
+    }
+
+    static GrainLanes getLanes(HeadLanes& lanes, LaneArray<int32_t>& startOffsets, LaneArray<int32_t>& windowOffsets, int firstLane) {
+        return { lanes.readIndex.data() + firstLane, lanes.readFrac.data() + firstLane, lanes.step.data() + firstLane,
+                 lanes.processed.data() + firstLane, lanes.total.data() + firstLane, lanes.envScale.data() + firstLane,
+                 startOffsets.data() + firstLane, windowOffsets.data() + firstLane };
+    }
+
+    GrainLanes getLanes(int head, int firstLane) {
+        return getLanes(heads[(size_t)head], startOffset, windowOffset, firstLane);
+    }
+
+    // Copies the first job.numLanes lanes, never allocates
+    void fillJobSlot(JobSlot& slot, const SpanJob& job) {
+        const auto copy = [count = job.numLanes](const auto& source, auto& destination) {
+            std::copy(source.data(), source.data() + count, destination.data());
+        };
+
+        slot.job = job;
+
+        for (int head = 0; head < layout.getNumHeads(); ++head) {
+            const auto& source = heads[(size_t)head];
+            auto& lanes = slot.heads[(size_t)head];
+            copy(source.readIndex, lanes.readIndex);
+            copy(source.readFrac, lanes.readFrac);
+            copy(source.step, lanes.step);
+            copy(source.processed, lanes.processed);
+            copy(source.total, lanes.total);
+            copy(source.envScale, lanes.envScale);
+        }
+
+        for (int channel = 0; channel < layout.getNumChannels(); ++channel)
+            copy(gains[(size_t)channel], slot.gains[(size_t)channel]);
+
+        copy(startOffset, slot.startOffset);
+        copy(windowOffset, slot.windowOffset);
+    }
+
+    int getAccumSize() const {
+        return maxSpanSamples * GrainKernels::maxLaneWidth * layout.getMaxHeadChannels();
+    }
+
+    // The copy of one head's lanes of chunk that executor advances. Only the state kernels write is
+    // copied, the rest points at the slot.
+    GrainLanes getChunkLanes(JobSlot& slot, int executor, int chunk, int head) {
+        const int offset = ((executor * maxChunks + chunk) * layout.getNumHeads() + head) * chunkLanes;
+
+        auto lanes = getLanes(slot.heads[(size_t)head], slot.startOffset, slot.windowOffset, chunk * chunkLanes);
+        lanes.readIndex = chunkReadIndex.data() + offset;
+        lanes.readFrac = chunkReadFrac.data() + offset;
+        lanes.processed = chunkProcessed.data() + offset;
+        return lanes;
+    }
+
+    float* getChunkOut(int executor, int chunk, int channel) {
+        return chunkOut.data() + ((executor * maxChunks + chunk) * layout.getNumChannels() + channel) * maxSpanSamples;
+    }
+
+    // Accumulate numLanes lanes from firstLane of job's span into the head's channels of out
+    void renderChunk(const SpanJob& job, const GrainLanes& lanes, const std::array<LaneArray<float>, maxChannels>& laneGains,
+                     int head, int firstLane, int numLanes, float* accum, float* const* out) const {
+        GrainOutputs outputs;
+        for (const int channel : layout.getHead(head)) {
+            const auto c = (size_t)outputs.numChannels++;
+            outputs.history[c] = job.history[(size_t)channel];
+            outputs.gain[c] = laneGains[(size_t)channel].data() + firstLane;
+            outputs.out[c] = out[channel];
+        }
+
+        job.kernels[(size_t)head](lanes, outputs, numLanes, job.mask, windows, accum, job.numSamples);
+    }
+
+    // Reads only the slot and what stays fixed until the next setWorkers, so it is safe however late it runs
+    static void renderChunkJob(void* context, int chunk, int executor) {
+        auto& slot = *static_cast<JobSlot*>(context);
+        auto& pool = *slot.pool;
+        const int firstLane = chunk * chunkLanes;
+        const int numLanes = std::min(chunkLanes, slot.job.numLanes - firstLane);
+
+        std::array<float*, maxChannels> out {};
+        for (int channel = 0; channel < pool.layout.getNumChannels(); ++channel) {
+            out[(size_t)channel] = pool.getChunkOut(executor, chunk, channel);
+            std::fill(out[(size_t)channel], out[(size_t)channel] + slot.job.numSamples, 0.0f);
+        }
+
+        float* accum = pool.executorAccum.data() + executor * pool.getAccumSize();
+
+        for (int head = 0; head < pool.layout.getNumHeads(); ++head) {
+            const auto source = getLanes(slot.heads[(size_t)head], slot.startOffset, slot.windowOffset, firstLane);
+            const auto lanes = pool.getChunkLanes(slot, executor, chunk, head);
+            std::copy(source.readIndex, source.readIndex + numLanes, lanes.readIndex);
+            std::copy(source.readFrac, source.readFrac + numLanes, lanes.readFrac);
+            std::copy(source.processed, source.processed + numLanes, lanes.processed);
+
+            pool.renderChunk(slot.job, lanes, slot.gains, head, firstLane, numLanes, accum, out.data());
         }
     }
-};
\ No newline at end of file
+
+    void checkCollision(
+        int slot,
+        double pos,
+        int writePos,
+        int mask,
+        std::atomic<bool>* collisionFlag,
+        std::atomic<float>* collisionSamples
+    ) {
+        int size = mask + 1;
+        int rInt = static_cast<int>(std::floor(pos));
+        int wrappedDist = (rInt - writePos) & mask;
+
+        if (wrappedDist > (size / 2)) { wrappedDist -= size; }
+
+        if (wrappedDist > 0) {
+            if (collisionFlag) *collisionFlag = true;
+            if (collisionSamples) *collisionSamples = (float)wrappedDist;
+
+            // Logged once per grain, a grain past the write head usually stays there for the rest of its life
+            if constexpr (GrainEvents::enabled) {
+                auto& info = debug[(size_t)slot];
+                if (!info.collision) pushEvent(GrainEvent::Type::collision, slot, writePos, { (float)wrappedDist });
+                info.collision = true;
+            }
+        }
+    }
+
+    void pushEvent(GrainEvent::Type type, int slot, int writePos, std::array<float, 4> values) {
+        if (eventLog != nullptr) eventLog->push({ type, triggerOrder[(size_t)slot], (int32_t)writePos, values });
+    }
+};
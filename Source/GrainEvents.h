@@ -0,0 +1,150 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <cstdint>
+
+// Grain lifecycle logging for instrumented builds. Configure with -DGRANULAR_GRAIN_EVENTS=ON and the pool
+// records every trigger, steal, collision and finish. Otherwise enabled is false, every use sits behind
+// if constexpr and release builds carry neither the code nor the per-grain debug state.
+#ifndef GRANULAR_GRAIN_EVENTS
+ #define GRANULAR_GRAIN_EVENTS 0
+#endif
+
+namespace GrainEvents {
+    constexpr bool enabled = GRANULAR_GRAIN_EVENTS != 0;
+}
+
+// One fixed-size record. What the values hold depends on the type:
+//   trigger    duration, delay of the first and last head, pitch of the last head
+//   steal      samples processed, total samples
+//   collision  distance past the write head
+//   finish     expected and actual samples read by the first head, then by the last
+struct GrainEvent {
+    enum class Type : uint8_t {
+        trigger,
+        steal,
+        collision,
+        finish
+    };
+
+    Type type = Type::trigger;
+    uint32_t grain = 0; // Trigger order, unique for the life of the pool
+    int32_t writePos = 0;
+    std::array<float, 4> values {};
+};
+
+// Single producer, single consumer ring of preallocated events. The audio thread pushes and never waits,
+// when the ring is full the event is dropped and counted instead.
+class GrainEventRing {
+public:
+    static constexpr uint32_t capacity = 1 << 14;
+
+    GrainEventRing() : events(capacity) {}
+
+    // Producer side
+    void push(const GrainEvent& event) {
+        const uint32_t head = writeIndex.load(std::memory_order_relaxed);
+
+        if (head - readIndex.load(std::memory_order_acquire) == capacity) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        events[head & (capacity - 1)] = event;
+        writeIndex.store(head + 1, std::memory_order_release);
+    }
+
+    // Consumer side, false once the ring is empty
+    bool pop(GrainEvent& event) {
+        const uint32_t tail = readIndex.load(std::memory_order_relaxed);
+        if (tail == writeIndex.load(std::memory_order_acquire)) return false;
+
+        event = events[tail & (capacity - 1)];
+        readIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<GrainEvent> events;
+    std::atomic<uint32_t> writeIndex { 0 };
+    std::atomic<uint32_t> readIndex { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+};
+
+// Drains the ring to a CSV file from a background thread, so the audio thread never touches the file.
+// start and stop are for the message thread, push is for the audio thread and only records while started.
+class GrainEventLog : private juce::Thread {
+public:
+    GrainEventLog() : juce::Thread("Grain event log") {}
+    ~GrainEventLog() override { stop(); }
+
+    bool start(const juce::File& file) {
+        stop();
+
+        file.deleteFile();
+        stream = file.createOutputStream();
+        if (stream == nullptr) return false;
+
+        *stream << "# trigger: duration, delay first, delay last, pitch last\n"
+                << "# steal: processed, total\n"
+                << "# collision: distance\n"
+                << "# finish: expected first, actual first, expected last, actual last\n"
+                << "event,grain,writePos,v0,v1,v2,v3\n";
+
+        // Anything pushed after the last stop belongs to no file
+        for (GrainEvent stale; ring.pop(stale);) {}
+
+        recording.store(true, std::memory_order_release);
+        return startThread();
+    }
+
+    void stop() {
+        recording.store(false, std::memory_order_release);
+        stopThread(1000);
+
+        if (stream != nullptr) {
+            drain();
+
+            if (const auto dropped = ring.getDropped(); dropped > 0)
+                *stream << "# dropped " << juce::String((juce::int64)dropped) << " events\n";
+
+            stream->flush();
+            stream.reset();
+        }
+    }
+
+    void push(const GrainEvent& event) {
+        if (recording.load(std::memory_order_relaxed)) ring.push(event);
+    }
+
+private:
+    static constexpr int drainIntervalMs = 50;
+
+    GrainEventRing ring;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    std::atomic<bool> recording { false };
+
+    void run() override {
+        while (!threadShouldExit()) {
+            drain();
+            wait(drainIntervalMs);
+        }
+    }
+
+    void drain() {
+        static constexpr const char* names[] { "trigger", "steal", "collision", "finish" };
+
+        GrainEvent event;
+        while (ring.pop(event)) {
+            *stream << names[(size_t)event.type] << "," << juce::String((juce::int64)event.grain) << "," << event.writePos;
+
+            for (const float value : event.values)
+                *stream << "," << juce::String(value, 3);
+
+            *stream << "\n";
+        }
+    }
+};
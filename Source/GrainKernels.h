@@ -0,0 +1,528 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "Interpolation.h"
+#include "SpeakerLayout.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #define GRAIN_KERNELS_X86 1
+ #include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) // 32-bit NEON lacks the across-vector and rounding intrinsics, it runs scalar
+ #define GRAIN_KERNELS_NEON 1
+ #include <arm_neon.h>
+#endif
+
+#if defined(GRAIN_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+ #define GRAIN_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+ #define GRAIN_KERNELS_TARGET_AVX2
+#endif
+
+// Hot per-grain state for one read head, one entry per pool slot. Every array is padded to a multiple of
+// maxLaneWidth so kernels can always load whole vectors.
+struct GrainLanes {
+    int32_t* readIndex;
+    float* readFrac;
+    const float* step;
+    int32_t* processed;
+    const int32_t* total;
+    const float* envScale;
+    const int32_t* startOffset;
+    const int32_t* windowOffset;
+};
+
+// The channels a head renders into, each with its own history, per-lane gains (laid out like GrainLanes)
+// and output span
+struct GrainOutputs {
+    int numChannels = 0;
+    std::array<const void*, SpeakerLayout::maxChannels> history {};
+    std::array<const float*, SpeakerLayout::maxChannels> gain {};
+    std::array<float*, SpeakerLayout::maxChannels> out {};
+};
+
+// Render numSamples of every lane in [0, numLanes) into each output (accumulating), advancing lane state.
+// Read positions and envelopes are computed once per sample and shared by all outputs.
+// history points at the channel's first float or int16 sample, whichever the kernel was selected for, with
+// consecutive samples stride apart for the layout it was selected for. It must carry Interpolation::maxTaps
+// guard samples past mask + 1.
+// envScale maps a lane's processed count onto the window table, windows is the WindowTables base pointer.
+// laneAccum must hold numSamples * maxLaneWidth floats per output, aligned to 32 bytes.
+// Kernels are instantiated for a fixed number of outputs, so the single-channel heads of stereo have the
+// channel loops folded away, and for 0, which takes outputs.numChannels.
+using GrainSpanKernel = void (*)(const GrainLanes& lanes, const GrainOutputs& outputs, int numLanes, int mask,
+                                 const float* windows, float* laneAccum, int numSamples);
+
+namespace GrainKernels {
+    static constexpr int maxLaneWidth = 8;
+
+    // Scalar fallback: grain-major over each lane's active part of the span
+    template <InterpolationMode mode, typename Sample, int stride, int channels>
+    inline void renderSpanScalar(const GrainLanes& lanes, const GrainOutputs& outputs, int numLanes, int mask,
+                                 const float* windows, float* /*laneAccum*/, int numSamples) {
+        const int numChannels = channels > 0 ? channels : outputs.numChannels;
+
+        for (int lane = 0; lane < numLanes; ++lane) {
+            const int offset = lanes.startOffset[lane];
+            const int spanSamples = std::min(numSamples - offset, lanes.total[lane] - lanes.processed[lane]);
+            if (spanSamples <= 0) continue;
+
+            int32_t index = lanes.readIndex[lane];
+            float frac = lanes.readFrac[lane];
+            int32_t processed = lanes.processed[lane];
+            const float step = lanes.step[lane];
+            const float envScale = lanes.envScale[lane];
+            const float* window = windows + lanes.windowOffset[lane];
+            const int band = Interpolation::SincTables::getBand(std::abs(step));
+
+            for (int i = 0; i < spanSamples; ++i) {
+                float phase = (float)processed * envScale;
+                int w = (int)phase;
+                float wFrac = phase - (float)w;
+                float envelope = window[w] + wFrac * (window[w + 1] - window[w]);
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    const Sample* history = static_cast<const Sample*>(outputs.history[(size_t)channel]);
+                    float sample = Interpolation::read<mode, stride>(history, mask, index, frac, band);
+                    outputs.out[(size_t)channel][offset + i] += sample * envelope * outputs.gain[(size_t)channel][lane];
+                }
+
+                frac += step;
+                float carry = std::floor(frac);
+                frac -= carry;
+                index += (int32_t)carry;
+                processed++;
+            }
+
+            lanes.readIndex[lane] = index;
+            lanes.readFrac[lane] = frac;
+            lanes.processed[lane] = processed;
+        }
+    }
+
+   #if defined(GRAIN_KERNELS_X86)
+    // One channel's interpolated sample for 4 lanes at index + frac
+    template <InterpolationMode mode, typename Sample, int stride>
+    inline __m128 readLanesSSE2(const Sample* history, int mask, __m128i index, __m128 frac, const int* bands) {
+        constexpr int width = 4;
+        alignas(16) int32_t i1[width];
+
+        if constexpr (mode == InterpolationMode::linear && std::is_same_v<Sample, float>) {
+            _mm_store_si128((__m128i*)i1, _mm_and_si128(index, _mm_set1_epi32(mask)));
+
+            __m128 s1 = _mm_setr_ps(history[i1[0] * stride], history[i1[1] * stride],
+                                    history[i1[2] * stride], history[i1[3] * stride]);
+            __m128 s2 = _mm_setr_ps(history[(i1[0] + 1) * stride], history[(i1[1] + 1) * stride],
+                                    history[(i1[2] + 1) * stride], history[(i1[3] + 1) * stride]);
+            return _mm_add_ps(s1, _mm_mul_ps(frac, _mm_sub_ps(s2, s1)));
+        }
+        else if constexpr (mode == InterpolationMode::linear) {
+            _mm_store_si128((__m128i*)i1, _mm_and_si128(index, _mm_set1_epi32(mask)));
+
+            // A 32-bit load at a tap holds it in the low half. Planar history has the second tap in
+            // the high half of the same load, interleaved history needs another load one frame on.
+            alignas(16) int32_t pairs[width];
+            alignas(16) int32_t next[width];
+            for (int l = 0; l < width; ++l) {
+                std::memcpy(&pairs[l], history + i1[l] * stride, sizeof(int32_t));
+                if constexpr (stride > 1) std::memcpy(&next[l], history + (i1[l] + 1) * stride, sizeof(int32_t));
+            }
+
+            __m128i pair = _mm_load_si128((const __m128i*)pairs);
+            __m128 s1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(pair, 16), 16));
+            __m128 s2;
+
+            if constexpr (stride == 1) s2 = _mm_cvtepi32_ps(_mm_srai_epi32(pair, 16));
+            else s2 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(_mm_load_si128((const __m128i*)next), 16), 16));
+            return _mm_mul_ps(_mm_add_ps(s1, _mm_mul_ps(frac, _mm_sub_ps(s2, s1))),
+                              _mm_set1_ps(Interpolation::getSampleScale<Sample>()));
+        }
+        else {
+            alignas(16) float fracs[width];
+            _mm_store_si128((__m128i*)i1, index);
+            _mm_store_ps(fracs, frac);
+
+            return _mm_setr_ps(Interpolation::read<mode, stride>(history, mask, i1[0], fracs[0], bands[0]),
+                               Interpolation::read<mode, stride>(history, mask, i1[1], fracs[1], bands[1]),
+                               Interpolation::read<mode, stride>(history, mask, i1[2], fracs[2], bands[2]),
+                               Interpolation::read<mode, stride>(history, mask, i1[3], fracs[3], bands[3]));
+        }
+    }
+
+    // 4 grains per instruction. SSE2 has no gather or floor, so taps are loaded per lane and floor is
+    // derived from truncation. Hermite and sinc taps are read per lane, everything else stays vectorised.
+    template <InterpolationMode mode, typename Sample, int stride, int channels>
+    inline void renderSpanSSE2(const GrainLanes& lanes, const GrainOutputs& outputs, int numLanes, int mask,
+                               const float* windows, float* laneAccum, int numSamples) {
+        constexpr int width = 4;
+        const int numChannels = channels > 0 ? channels : outputs.numChannels;
+        std::fill(laneAccum, laneAccum + numChannels * numSamples * width, 0.0f);
+
+        const __m128 oneF = _mm_set1_ps(1.0f);
+
+        alignas(16) int32_t w1[width];
+        int bands[width];
+        __m128 gains[SpeakerLayout::maxChannels];
+
+        for (int lane = 0; lane < numLanes; lane += width) {
+            __m128i processed = _mm_load_si128((const __m128i*)(lanes.processed + lane));
+            const __m128i total = _mm_load_si128((const __m128i*)(lanes.total + lane));
+
+            if (_mm_movemask_epi8(_mm_cmplt_epi32(processed, total)) == 0) continue;
+
+            __m128i index = _mm_load_si128((const __m128i*)(lanes.readIndex + lane));
+            __m128 frac = _mm_load_ps(lanes.readFrac + lane);
+            const __m128 step = _mm_load_ps(lanes.step + lane);
+            const __m128 envScale = _mm_load_ps(lanes.envScale + lane);
+            const __m128i offset = _mm_load_si128((const __m128i*)(lanes.startOffset + lane));
+            const __m128i windowOffset = _mm_load_si128((const __m128i*)(lanes.windowOffset + lane));
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                gains[channel] = _mm_load_ps(outputs.gain[(size_t)channel] + lane);
+
+            for (int l = 0; l < width; ++l)
+                bands[l] = Interpolation::SincTables::getBand(std::abs(lanes.step[lane + l]));
+
+            for (int i = 0; i < numSamples; ++i) {
+                // Lanes contribute from their start offset until they run out of samples
+                __m128i live = _mm_andnot_si128(_mm_cmpgt_epi32(offset, _mm_set1_epi32(i)),
+                                                _mm_cmplt_epi32(processed, total));
+                __m128 liveF = _mm_castsi128_ps(live);
+
+                // Window phase is never negative, so truncation is floor
+                __m128 phase = _mm_mul_ps(_mm_cvtepi32_ps(processed), envScale);
+                __m128i phaseIndex = _mm_cvttps_epi32(phase);
+                __m128 phaseFrac = _mm_sub_ps(phase, _mm_cvtepi32_ps(phaseIndex));
+                _mm_store_si128((__m128i*)w1, _mm_add_epi32(phaseIndex, windowOffset));
+
+                __m128 e1 = _mm_setr_ps(windows[w1[0]], windows[w1[1]], windows[w1[2]], windows[w1[3]]);
+                __m128 e2 = _mm_setr_ps(windows[w1[0] + 1], windows[w1[1] + 1], windows[w1[2] + 1], windows[w1[3] + 1]);
+                __m128 envelope = _mm_add_ps(e1, _mm_mul_ps(phaseFrac, _mm_sub_ps(e2, e1)));
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    const Sample* history = static_cast<const Sample*>(outputs.history[(size_t)channel]);
+                    __m128 sample = readLanesSSE2<mode, Sample, stride>(history, mask, index, frac, bands);
+
+                    __m128 contribution = _mm_and_ps(_mm_mul_ps(_mm_mul_ps(sample, envelope), gains[channel]), liveF);
+                    float* acc = laneAccum + (channel * numSamples + i) * width;
+                    _mm_store_ps(acc, _mm_add_ps(_mm_load_ps(acc), contribution));
+                }
+
+                // Advance live lanes only
+                frac = _mm_add_ps(frac, _mm_and_ps(step, liveF));
+                __m128i truncated = _mm_cvttps_epi32(frac);
+                __m128 truncatedF = _mm_cvtepi32_ps(truncated);
+                __m128 floorF = _mm_sub_ps(truncatedF, _mm_and_ps(_mm_cmpgt_ps(truncatedF, frac), oneF));
+                frac = _mm_sub_ps(frac, floorF);
+                index = _mm_add_epi32(index, _mm_cvttps_epi32(floorF));
+                processed = _mm_sub_epi32(processed, live);
+            }
+
+            _mm_store_si128((__m128i*)(lanes.readIndex + lane), index);
+            _mm_store_ps(lanes.readFrac + lane, frac);
+            _mm_store_si128((__m128i*)(lanes.processed + lane), processed);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* accum = laneAccum + channel * numSamples * width;
+            float* out = outputs.out[(size_t)channel];
+
+            for (int i = 0; i < numSamples; ++i) {
+                __m128 v = _mm_load_ps(accum + i * width);
+                __m128 hi = _mm_movehl_ps(v, v);
+                __m128 sum = _mm_add_ps(v, hi);
+                sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+                out[i] += _mm_cvtss_f32(sum);
+            }
+        }
+    }
+
+    // One channel's interpolated sample for 8 lanes, with hardware gathers for linear taps
+    template <InterpolationMode mode, typename Sample, int stride>
+    GRAIN_KERNELS_TARGET_AVX2
+    inline __m256 readLanesAVX2(const Sample* history, int mask, __m256i index, __m256 frac, const int* bands) {
+        constexpr int width = 8;
+        const __m256i oneI = _mm256_set1_epi32(1);
+
+        if constexpr (mode == InterpolationMode::linear && std::is_same_v<Sample, float>) {
+            __m256i wrapped = _mm256_and_si256(index, _mm256_set1_epi32(mask));
+
+            __m256 s1 = _mm256_i32gather_ps(history, wrapped, 4 * stride);
+            __m256 s2 = _mm256_i32gather_ps(history, _mm256_add_epi32(wrapped, oneI), 4 * stride);
+            return _mm256_add_ps(s1, _mm256_mul_ps(frac, _mm256_sub_ps(s2, s1)));
+        }
+        else if constexpr (mode == InterpolationMode::linear) {
+            __m256i wrapped = _mm256_and_si256(index, _mm256_set1_epi32(mask));
+
+            // Planar history has both int16 taps of every lane in one gather, the first in the low half.
+            // Interleaved history has one tap at the bottom of each frame and takes a gather per tap.
+            __m256i pair = _mm256_i32gather_epi32((const int*)history, wrapped, 2 * stride);
+            __m256 s1 = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pair, 16), 16));
+            __m256 s2;
+
+            if constexpr (stride == 1) {
+                s2 = _mm256_cvtepi32_ps(_mm256_srai_epi32(pair, 16));
+            }
+            else {
+                __m256i next = _mm256_i32gather_epi32((const int*)history, _mm256_add_epi32(wrapped, oneI), 2 * stride);
+                s2 = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(next, 16), 16));
+            }
+            return _mm256_mul_ps(_mm256_add_ps(s1, _mm256_mul_ps(frac, _mm256_sub_ps(s2, s1))),
+                                 _mm256_set1_ps(Interpolation::getSampleScale<Sample>()));
+        }
+        else {
+            alignas(32) int32_t i1[width];
+            alignas(32) float fracs[width];
+            _mm256_store_si256((__m256i*)i1, index);
+            _mm256_store_ps(fracs, frac);
+
+            alignas(32) float samples[width];
+            for (int l = 0; l < width; ++l)
+                samples[l] = Interpolation::read<mode, stride>(history, mask, i1[l], fracs[l], bands[l]);
+
+            return _mm256_load_ps(samples);
+        }
+    }
+
+    // 8 grains per instruction with hardware gathers for linear taps and the window
+    template <InterpolationMode mode, typename Sample, int stride, int channels>
+    GRAIN_KERNELS_TARGET_AVX2
+    inline void renderSpanAVX2(const GrainLanes& lanes, const GrainOutputs& outputs, int numLanes, int mask,
+                               const float* windows, float* laneAccum, int numSamples) {
+        constexpr int width = 8;
+        const int numChannels = channels > 0 ? channels : outputs.numChannels;
+        std::fill(laneAccum, laneAccum + numChannels * numSamples * width, 0.0f);
+
+        const __m256i oneI = _mm256_set1_epi32(1);
+
+        int bands[width];
+        __m256 gains[SpeakerLayout::maxChannels];
+
+        for (int lane = 0; lane < numLanes; lane += width) {
+            __m256i processed = _mm256_load_si256((const __m256i*)(lanes.processed + lane));
+            const __m256i total = _mm256_load_si256((const __m256i*)(lanes.total + lane));
+
+            if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(total, processed)) == 0) continue;
+
+            __m256i index = _mm256_load_si256((const __m256i*)(lanes.readIndex + lane));
+            __m256 frac = _mm256_load_ps(lanes.readFrac + lane);
+            const __m256 step = _mm256_load_ps(lanes.step + lane);
+            const __m256 envScale = _mm256_load_ps(lanes.envScale + lane);
+            const __m256i offset = _mm256_load_si256((const __m256i*)(lanes.startOffset + lane));
+            const __m256i windowOffset = _mm256_load_si256((const __m256i*)(lanes.windowOffset + lane));
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                gains[channel] = _mm256_load_ps(outputs.gain[(size_t)channel] + lane);
+
+            for (int l = 0; l < width; ++l)
+                bands[l] = Interpolation::SincTables::getBand(std::abs(lanes.step[lane + l]));
+
+            for (int i = 0; i < numSamples; ++i) {
+                __m256i live = _mm256_andnot_si256(_mm256_cmpgt_epi32(offset, _mm256_set1_epi32(i)),
+                                                   _mm256_cmpgt_epi32(total, processed));
+                __m256 liveF = _mm256_castsi256_ps(live);
+
+                __m256 phase = _mm256_mul_ps(_mm256_cvtepi32_ps(processed), envScale);
+                __m256i phaseIndex = _mm256_cvttps_epi32(phase);
+                __m256 phaseFrac = _mm256_sub_ps(phase, _mm256_cvtepi32_ps(phaseIndex));
+                __m256i w1 = _mm256_add_epi32(phaseIndex, windowOffset);
+
+                __m256 e1 = _mm256_i32gather_ps(windows, w1, 4);
+                __m256 e2 = _mm256_i32gather_ps(windows, _mm256_add_epi32(w1, oneI), 4);
+                __m256 envelope = _mm256_add_ps(e1, _mm256_mul_ps(phaseFrac, _mm256_sub_ps(e2, e1)));
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    const Sample* history = static_cast<const Sample*>(outputs.history[(size_t)channel]);
+                    __m256 sample = readLanesAVX2<mode, Sample, stride>(history, mask, index, frac, bands);
+
+                    __m256 contribution = _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(sample, envelope), gains[channel]), liveF);
+                    float* acc = laneAccum + (channel * numSamples + i) * width;
+                    _mm256_store_ps(acc, _mm256_add_ps(_mm256_load_ps(acc), contribution));
+                }
+
+                frac = _mm256_add_ps(frac, _mm256_and_ps(step, liveF));
+                __m256 floorF = _mm256_floor_ps(frac);
+                frac = _mm256_sub_ps(frac, floorF);
+                index = _mm256_add_epi32(index, _mm256_cvttps_epi32(floorF));
+                processed = _mm256_sub_epi32(processed, live);
+            }
+
+            _mm256_store_si256((__m256i*)(lanes.readIndex + lane), index);
+            _mm256_store_ps(lanes.readFrac + lane, frac);
+            _mm256_store_si256((__m256i*)(lanes.processed + lane), processed);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* accum = laneAccum + channel * numSamples * width;
+            float* out = outputs.out[(size_t)channel];
+
+            for (int i = 0; i < numSamples; ++i) {
+                __m256 v = _mm256_load_ps(accum + i * width);
+                __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+                sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+                sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+                out[i] += _mm_cvtss_f32(sum);
+            }
+        }
+    }
+   #endif
+
+   #if defined(GRAIN_KERNELS_NEON)
+    // One channel's interpolated sample for 4 lanes at index + frac
+    template <InterpolationMode mode, typename Sample, int stride>
+    inline float32x4_t readLanesNEON(const Sample* history, int mask, int32x4_t index, float32x4_t frac, const int* bands) {
+        constexpr int width = 4;
+        alignas(16) int32_t i1[width];
+
+        if constexpr (mode == InterpolationMode::linear) {
+            vst1q_s32(i1, vandq_s32(index, vdupq_n_s32(mask)));
+
+            alignas(16) float t1[width];
+            alignas(16) float t2[width];
+            for (int l = 0; l < width; ++l) {
+                t1[l] = (float)history[i1[l] * stride];
+                t2[l] = (float)history[(i1[l] + 1) * stride];
+            }
+
+            float32x4_t s1 = vld1q_f32(t1);
+            float32x4_t s2 = vld1q_f32(t2);
+            float32x4_t sample = vmlaq_f32(s1, frac, vsubq_f32(s2, s1));
+
+            if constexpr (!std::is_same_v<Sample, float>)
+                sample = vmulq_n_f32(sample, Interpolation::getSampleScale<Sample>());
+
+            return sample;
+        }
+        else {
+            alignas(16) float fracs[width];
+            vst1q_s32(i1, index);
+            vst1q_f32(fracs, frac);
+
+            alignas(16) float samples[width];
+            for (int l = 0; l < width; ++l)
+                samples[l] = Interpolation::read<mode, stride>(history, mask, i1[l], fracs[l], bands[l]);
+
+            return vld1q_f32(samples);
+        }
+    }
+
+    // 4 grains per instruction
+    template <InterpolationMode mode, typename Sample, int stride, int channels>
+    inline void renderSpanNEON(const GrainLanes& lanes, const GrainOutputs& outputs, int numLanes, int mask,
+                               const float* windows, float* laneAccum, int numSamples) {
+        constexpr int width = 4;
+        const int numChannels = channels > 0 ? channels : outputs.numChannels;
+        std::fill(laneAccum, laneAccum + numChannels * numSamples * width, 0.0f);
+
+        alignas(16) int32_t w1[width];
+        int bands[width];
+        float32x4_t gains[SpeakerLayout::maxChannels];
+
+        for (int lane = 0; lane < numLanes; lane += width) {
+            int32x4_t processed = vld1q_s32(lanes.processed + lane);
+            const int32x4_t total = vld1q_s32(lanes.total + lane);
+
+            if (vmaxvq_u32(vcltq_s32(processed, total)) == 0) continue;
+
+            int32x4_t index = vld1q_s32(lanes.readIndex + lane);
+            float32x4_t frac = vld1q_f32(lanes.readFrac + lane);
+            const float32x4_t step = vld1q_f32(lanes.step + lane);
+            const float32x4_t envScale = vld1q_f32(lanes.envScale + lane);
+            const int32x4_t offset = vld1q_s32(lanes.startOffset + lane);
+            const int32x4_t windowOffset = vld1q_s32(lanes.windowOffset + lane);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                gains[channel] = vld1q_f32(outputs.gain[(size_t)channel] + lane);
+
+            for (int l = 0; l < width; ++l)
+                bands[l] = Interpolation::SincTables::getBand(std::abs(lanes.step[lane + l]));
+
+            for (int i = 0; i < numSamples; ++i) {
+                uint32x4_t live = vandq_u32(vcleq_s32(offset, vdupq_n_s32(i)), vcltq_s32(processed, total));
+
+                float32x4_t phase = vmulq_f32(vcvtq_f32_s32(processed), envScale);
+                int32x4_t phaseIndex = vcvtq_s32_f32(phase);
+                float32x4_t phaseFrac = vsubq_f32(phase, vcvtq_f32_s32(phaseIndex));
+                vst1q_s32(w1, vaddq_s32(phaseIndex, windowOffset));
+
+                alignas(16) const float u1[width] = { windows[w1[0]], windows[w1[1]], windows[w1[2]], windows[w1[3]] };
+                alignas(16) const float u2[width] = { windows[w1[0] + 1], windows[w1[1] + 1], windows[w1[2] + 1], windows[w1[3] + 1] };
+                float32x4_t e1 = vld1q_f32(u1);
+                float32x4_t e2 = vld1q_f32(u2);
+                float32x4_t envelope = vmlaq_f32(e1, phaseFrac, vsubq_f32(e2, e1));
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    const Sample* history = static_cast<const Sample*>(outputs.history[(size_t)channel]);
+                    float32x4_t sample = readLanesNEON<mode, Sample, stride>(history, mask, index, frac, bands);
+
+                    float32x4_t contribution = vmulq_f32(vmulq_f32(sample, envelope), gains[channel]);
+                    contribution = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(contribution), live));
+                    float* acc = laneAccum + (channel * numSamples + i) * width;
+                    vst1q_f32(acc, vaddq_f32(vld1q_f32(acc), contribution));
+                }
+
+                frac = vaddq_f32(frac, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(step), live)));
+                float32x4_t floorF = vrndmq_f32(frac);
+                frac = vsubq_f32(frac, floorF);
+                index = vaddq_s32(index, vcvtq_s32_f32(floorF));
+                processed = vsubq_s32(processed, vreinterpretq_s32_u32(live));
+            }
+
+            vst1q_s32(lanes.readIndex + lane, index);
+            vst1q_f32(lanes.readFrac + lane, frac);
+            vst1q_s32(lanes.processed + lane, processed);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* accum = laneAccum + channel * numSamples * width;
+            float* out = outputs.out[(size_t)channel];
+
+            for (int i = 0; i < numSamples; ++i)
+                out[i] += vaddvq_f32(vld1q_f32(accum + i * width));
+        }
+    }
+   #endif
+
+    // Pick the widest kernel the running CPU supports
+    template <InterpolationMode mode, typename Sample, int stride, int channels>
+    inline GrainSpanKernel selectSpanKernel() {
+       #if defined(GRAIN_KERNELS_X86)
+        if (juce::SystemStats::hasAVX2()) return renderSpanAVX2<mode, Sample, stride, channels>;
+        return renderSpanSSE2<mode, Sample, stride, channels>;
+       #elif defined(GRAIN_KERNELS_NEON)
+        return renderSpanNEON<mode, Sample, stride, channels>;
+       #else
+        return renderSpanScalar<mode, Sample, stride, channels>;
+       #endif
+    }
+
+    template <typename Sample, int stride, int channels>
+    inline GrainSpanKernel selectSpanKernel(InterpolationMode mode) {
+        switch (mode) {
+            case InterpolationMode::hermite: return selectSpanKernel<InterpolationMode::hermite, Sample, stride, channels>();
+            case InterpolationMode::sinc:    return selectSpanKernel<InterpolationMode::sinc, Sample, stride, channels>();
+            case InterpolationMode::linear:
+            default:                         return selectSpanKernel<InterpolationMode::linear, Sample, stride, channels>();
+        }
+    }
+
+    template <int channels>
+    inline GrainSpanKernel selectSpanKernel(InterpolationMode mode, HistoryFormat format, HistoryLayout layout) {
+        constexpr int frame = 2;
+
+        if (format == HistoryFormat::int16) {
+            if (layout == HistoryLayout::interleaved) return selectSpanKernel<int16_t, frame, channels>(mode);
+            return selectSpanKernel<int16_t, 1, channels>(mode);
+        }
+
+        if (layout == HistoryLayout::interleaved) return selectSpanKernel<float, frame, channels>(mode);
+        return selectSpanKernel<float, 1, channels>(mode);
+    }
+
+    // Single-channel heads get the fixed-count kernels, wider ones the general kernels
+    inline GrainSpanKernel selectSpanKernel(InterpolationMode mode, HistoryFormat format, HistoryLayout layout, bool singleChannel) {
+        if (singleChannel) return selectSpanKernel<1>(mode, format, layout);
+        return selectSpanKernel<0>(mode, format, layout);
+    }
+}
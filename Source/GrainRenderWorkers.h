@@ -0,0 +1,309 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #include <immintrin.h>
+#endif
+
+// Preallocated helper threads for the audio thread, which never takes a lock or makes a system call to
+// use them. Helpers poll a flag: while a block is being processed they spin waiting for work, between
+// blocks they sleep in 1 ms steps until the next block is due and then spin again, so handing a job over
+// costs a cache line. A block that comes early or after a pause just finds the helpers a little late.
+//
+// Jobs are claimed from one shared counter that the calling thread also draws from, so it never waits on
+// a job nobody has started. Once it runs out of jobs it waits a bounded time for the helpers' results
+// and runs the jobs they haven't finished itself. A helper that gets descheduled only costs parallelism,
+// it can't stall the block. It may still be reading its job's context after run has returned, so each
+// helper marks the context it is working from, and the caller checks isInUse before reusing one.
+class GrainRenderWorkers {
+public:
+    // executor is 0 on the calling thread and 1 + the helper index on a helper
+    using Job = void (*)(void* context, int index, int executor);
+
+    static constexpr int maxWorkers = 8;
+    static constexpr int maxJobs = 128;
+
+    ~GrainRenderWorkers() {
+        stop();
+    }
+
+    // Starts the threads, so call from prepareToPlay or the message thread.
+    // Helpers give up spinning blockSeconds * 2 after a block starts, in case endBlock never comes.
+    void start(int numWorkers, double blockSeconds) {
+        stop();
+
+        const double ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+        blockTicks = (juce::int64)(juce::jmax(0.001, blockSeconds) * ticksPerSecond);
+        spinAheadTicks = (juce::int64)(spinAheadSeconds * ticksPerSecond);
+        minWaitTicks = (juce::int64)(minWaitSeconds * ticksPerSecond);
+
+        for (int i = 0; i < juce::jlimit(0, maxWorkers, numWorkers); ++i) {
+            workers.push_back(std::make_unique<Worker>(*this, i));
+            auto& worker = *workers.back();
+
+            if (!worker.startRealtimeThread(juce::Thread::RealtimeOptions {}.withPriority(8)))
+                worker.startThread(juce::Thread::Priority::highest);
+        }
+    }
+
+    // Helpers notice within a millisecond, and a job they were late with is finished before this returns
+    void stop() {
+        blockActive.store(false, std::memory_order_release);
+
+        for (auto& worker : workers)
+            worker->signalThreadShouldExit();
+
+        for (auto& worker : workers)
+            worker->stopThread(1000);
+
+        workers.clear();
+    }
+
+    int getNumWorkers() const { return (int)workers.size(); }
+
+    // Bracket the part of a block that calls run, helpers only spin in between
+    void beginBlock() {
+        if (workers.empty()) return;
+
+        blockStartTicks.store(juce::Time::getHighResolutionTicks(), std::memory_order_relaxed);
+        blockActive.store(true, std::memory_order_release);
+    }
+
+    void endBlock() {
+        if (workers.empty()) return;
+
+        blockActive.store(false, std::memory_order_release);
+        blockEndTicks.store(juce::Time::getHighResolutionTicks(), std::memory_order_relaxed);
+    }
+
+    bool isBlockActive() const { return blockActive.load(std::memory_order_relaxed); }
+
+    // Runs job(context, i, executor) for every i in [0, numJobs) and returns once each has a result, which
+    // getExecutor tells apart. Jobs must write only to outputs of their own index and executor: when a
+    // helper is late its job runs again on the calling thread, and the helper may carry on writing its
+    // own copy after run has returned. Anything a job reads must stay put until isInUse(context) is false.
+    void run(int numJobs, Job job, void* context) {
+        jassert(numJobs <= maxJobs);
+
+        if (workers.empty() || numJobs < 2 || !isBlockActive()) {
+            for (int i = 0; i < numJobs; ++i) {
+                job(context, i, 0);
+                results[(size_t)i].store(0, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        currentJob.store(job, std::memory_order_relaxed);
+        currentContext.store(context, std::memory_order_relaxed);
+        ++generation;
+
+        for (int i = 0; i < numJobs; ++i)
+            results[(size_t)i].store(pack(generation, pending), std::memory_order_relaxed);
+
+        // Generation in the top half so a helper holding a stale ticket can never claim from this run
+        ticket.store(((uint64_t)generation << 32) | ((uint64_t)numJobs << 16), std::memory_order_release);
+
+        const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+        int localJobs = 0;
+
+        for (int index; (index = claimNextJob(nullptr).index) >= 0; ++localJobs) {
+            job(context, index, 0);
+            results[(size_t)index].store(pack(generation, 0), std::memory_order_relaxed);
+        }
+
+        // Helpers get twice as long as the jobs here took on average before theirs are taken back
+        const juce::int64 claimedTicks = juce::Time::getHighResolutionTicks();
+        const juce::int64 waitTicks = localJobs > 0 ? juce::jmax(minWaitTicks, 2 * (claimedTicks - startTicks) / localJobs) : minWaitTicks;
+        const juce::int64 deadline = claimedTicks + waitTicks;
+
+        for (int index = 0; index < numJobs; ++index) {
+            auto& result = results[(size_t)index];
+
+            while (result.load(std::memory_order_acquire) == pack(generation, pending)) {
+                if (juce::Time::getHighResolutionTicks() > deadline) {
+                    uint64_t expected = pack(generation, pending);
+
+                    if (result.compare_exchange_strong(expected, pack(generation, 0), std::memory_order_acq_rel))
+                        job(context, index, 0);
+                    break;
+                }
+
+                pause();
+            }
+        }
+    }
+
+    // Whose output holds the result of job index after run
+    int getExecutor(int index) const {
+        return (int)(results[(size_t)index].load(std::memory_order_relaxed) & 0xffffffff);
+    }
+
+    // True while a helper may still be reading context, from a job it claimed in an earlier run. Call from
+    // the thread that calls run. A helper whose claim is about to fail can show up for a moment too.
+    bool isInUse(const void* context) const {
+        for (const auto& marked : inUse)
+            if (marked.load(std::memory_order_acquire) == context)
+                return true;
+
+        return false;
+    }
+
+    // No helper is inside a job, so nothing a past run handed out is still being read
+    bool isIdle() const {
+        for (const auto& marked : inUse)
+            if (marked.load(std::memory_order_acquire) != nullptr)
+                return false;
+
+        return true;
+    }
+
+private:
+    class Worker : public juce::Thread {
+    public:
+        Worker(GrainRenderWorkers& o, int index) : juce::Thread("Grain render " + juce::String(index)), owner(o), executor(index + 1) {}
+
+        void run() override {
+            juce::int64 abandonedBlock = -1;
+
+            while (!threadShouldExit()) {
+                if (owner.blockActive.load(std::memory_order_acquire)) {
+                    const juce::int64 blockStart = owner.blockStartTicks.load(std::memory_order_relaxed);
+
+                    if (blockStart != abandonedBlock) {
+                        if (!help(blockStart)) abandonedBlock = blockStart;
+                        continue;
+                    }
+                }
+                else if (owner.isBlockDue()) {
+                    pause();
+                    continue;
+                }
+
+                sleep(1);
+            }
+        }
+
+    private:
+        GrainRenderWorkers& owner;
+        const int executor;
+
+        // False when the block outlasted the spin deadline, so it isn't worth spinning for any longer
+        bool help(juce::int64 blockStart) {
+            const juce::int64 deadline = blockStart + 2 * owner.blockTicks;
+            auto& marked = owner.inUse[(size_t)executor - 1];
+            int idleSpins = 0;
+
+            while (owner.blockActive.load(std::memory_order_acquire) && !threadShouldExit()) {
+                if (const auto claim = owner.claimNextJob(&marked); claim.index >= 0) {
+                    claim.job(claim.context, claim.index, executor);
+                    marked.store(nullptr, std::memory_order_release);
+
+                    // Fails when the caller has taken the job back, then this result is never looked at
+                    uint64_t expected = pack(claim.generation, pending);
+                    owner.results[(size_t)claim.index].compare_exchange_strong(expected, pack(claim.generation, (uint32_t)executor),
+                                                                               std::memory_order_acq_rel);
+                    idleSpins = 0;
+                    continue;
+                }
+
+                pause();
+
+                if (++idleSpins % 256 == 0 && juce::Time::getHighResolutionTicks() > deadline)
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+    struct Claim {
+        int index = -1;
+        uint32_t generation = 0;
+        Job job = nullptr;
+        void* context = nullptr;
+    };
+
+    // Helpers spin from this long before the next block is due, which covers oversleeping a 1 ms sleep,
+    // until it is two blocks late. They also keep spinning this long after a block for hosts that render
+    // blocks back to back.
+    static constexpr double spinAheadSeconds = 0.0015;
+
+    // Shortest time the caller waits for helpers once it has claimed every job
+    static constexpr double minWaitSeconds = 0.00002;
+
+    static constexpr uint32_t pending = 0xffffffff;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::atomic<bool> blockActive { false };
+    std::atomic<juce::int64> blockStartTicks { 0 };
+    std::atomic<juce::int64> blockEndTicks { 0 };
+    juce::int64 blockTicks = 0;
+    juce::int64 spinAheadTicks = 0;
+    juce::int64 minWaitTicks = 0;
+
+    // generation << 32 | numJobs << 16 | next job
+    std::atomic<uint64_t> ticket { 0 };
+    uint32_t generation = 0;
+
+    // generation << 32 | executor, or pending until a result is in
+    std::array<std::atomic<uint64_t>, maxJobs> results {};
+
+    // Set before the ticket is published. A helper can read the next run's values here, but then the
+    // ticket it read them with has moved on and its claim fails.
+    std::atomic<Job> currentJob { nullptr };
+    std::atomic<void*> currentContext { nullptr };
+
+    // Per helper, the context of the job it is claiming or running, null otherwise
+    std::array<std::atomic<const void*>, maxWorkers> inUse {};
+
+    static uint64_t pack(uint32_t generation, uint32_t executor) {
+        return ((uint64_t)generation << 32) | executor;
+    }
+
+    bool isBlockDue() const {
+        const juce::int64 now = juce::Time::getHighResolutionTicks();
+        const juce::int64 due = blockStartTicks.load(std::memory_order_relaxed) + blockTicks;
+
+        return now < blockEndTicks.load(std::memory_order_relaxed) + spinAheadTicks
+            || (now > due - spinAheadTicks && now < due + 2 * blockTicks);
+    }
+
+    // Claim one job of the current run, index -1 once every job has been claimed. A helper passes its
+    // inUse entry, which is set to the job's context before the claim can succeed: the caller only
+    // returns from run after it has seen every claim, and so sees the mark as well. The job and context
+    // are read under the ticket the claim is made with, so they always belong to the claimed run.
+    Claim claimNextJob(std::atomic<const void*>* marked) {
+        uint64_t current = ticket.load(std::memory_order_acquire);
+
+        for (;;) {
+            const int next = (int)(current & 0xffff);
+            const int count = (int)((current >> 16) & 0xffff);
+
+            if (next >= count) {
+                if (marked != nullptr && marked->load(std::memory_order_relaxed) != nullptr)
+                    marked->store(nullptr, std::memory_order_release);
+                return {};
+            }
+
+            Claim claim { next, (uint32_t)(current >> 32), currentJob.load(std::memory_order_relaxed), currentContext.load(std::memory_order_relaxed) };
+            if (marked != nullptr) marked->store(claim.context, std::memory_order_relaxed);
+
+            if (ticket.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                return claim;
+        }
+    }
+
+    static void pause() {
+       #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+       #elif defined(_MSC_VER) && defined(_M_ARM64)
+        __yield();
+       #elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__ ("yield");
+       #endif
+    }
+};
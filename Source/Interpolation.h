@@ -0,0 +1,324 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #define INTERPOLATION_SSE 1
+ #include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #define INTERPOLATION_NEON 1
+ #include <arm_neon.h>
+#endif
+
+// Fractional read quality tiers, cheapest first
+enum class InterpolationMode {
+    linear = 0,
+    hermite,
+    sinc,
+    numModes
+};
+
+// Sample storage of a history buffer. int16 halves the memory and cache footprint of every read.
+enum class HistoryFormat {
+    float32 = 0,
+    int16,
+    numFormats
+};
+
+// Channel arrangement of a history buffer. Interleaved keeps both channels of a frame side by side, so
+// reads of the two channels at nearby positions share cache lines.
+enum class HistoryLayout {
+    planar = 0,
+    interleaved,
+    numLayouts
+};
+
+namespace Interpolation {
+    // History buffers keep this many samples mirrored past their end, so every tap of a read is contiguous
+    static constexpr int maxTaps = 32;
+
+    inline juce::StringArray getModeNames() {
+        return { "Linear", "Hermite", "Sinc" };
+    }
+
+    inline juce::StringArray getFormatNames() {
+        return { "Float", "Int16" };
+    }
+
+    inline juce::StringArray getLayoutNames() {
+        return { "Planar", "Interleaved" };
+    }
+
+    struct StereoSample {
+        float left = 0.0f;
+        float right = 0.0f;
+    };
+
+    // Full scale of a stored sample. Interpolation is linear in the taps, so int16 taps are filtered as
+    // they are and the result scaled once.
+    template <typename Sample>
+    constexpr float getSampleScale() {
+        static_assert(std::is_same_v<Sample, float> || std::is_same_v<Sample, int16_t>);
+        if constexpr (std::is_same_v<Sample, int16_t>) return 1.0f / 32768.0f;
+        else return 1.0f;
+    }
+
+    //==============================================================================
+    // Band-limited polyphase sinc. Reading faster than realtime decimates, so each pitch band gets its own
+    // Kaiser-windowed kernel with the cutoff lowered by the band's ratio and the taps widened to match.
+    class SincTables {
+    public:
+        static constexpr int numBands = 3;
+        static constexpr int numPhases = 256;
+        static constexpr int baseTaps = 8;
+
+        // Built on first use, which the processor makes sure happens on the message thread
+        static const SincTables& getInstance() {
+            static const SincTables instance;
+            return instance;
+        }
+
+        // Band 0 covers pitch up to 1, band 1 up to 2, band 2 everything above
+        static int getBand(float pitchStep) {
+            return pitchStep <= 1.0f ? 0 : (pitchStep <= 2.0f ? 1 : 2);
+        }
+
+        static constexpr int getNumTaps(int band) { return baseTaps << band; }
+
+        // Coefficient row for a phase, the next row is always valid for interpolation between phases
+        const float* getRow(int band, int phase) const {
+            return tables[(size_t)band].data() + (size_t)(phase * getNumTaps(band));
+        }
+
+    private:
+        std::array<std::vector<float>, numBands> tables;
+
+        SincTables() {
+            constexpr double pi = juce::MathConstants<double>::pi;
+            constexpr double beta = 7.0;
+
+            auto besselI0 = [](double x) {
+                double sum = 1.0, term = 1.0;
+                for (int k = 1; k < 32; ++k) {
+                    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                    sum += term;
+                }
+                return sum;
+            };
+
+            for (int band = 0; band < numBands; ++band) {
+                const int taps = getNumTaps(band);
+                const double cutoff = 0.45 / (double)(1 << band);
+                const double halfWidth = taps / 2.0;
+
+                auto& table = tables[(size_t)band];
+                table.resize((size_t)((numPhases + 1) * taps));
+
+                for (int phase = 0; phase <= numPhases; ++phase) {
+                    const double frac = (double)phase / numPhases;
+                    float* row = table.data() + (size_t)(phase * taps);
+                    double sum = 0.0;
+
+                    for (int k = 0; k < taps; ++k) {
+                        // Distance from the read position to tap k, taps start halfWidth - 1 samples back
+                        double t = (double)(k - (taps / 2 - 1)) - frac;
+                        double x = 2.0 * cutoff * t;
+                        double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+                        double r = t / halfWidth;
+                        double window = std::abs(r) >= 1.0 ? 0.0 : besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+
+                        row[k] = (float)(2.0 * cutoff * sinc * window);
+                        sum += row[k];
+                    }
+
+                    // Unity gain at DC for every phase
+                    for (int k = 0; k < taps; ++k)
+                        row[k] = (float)(row[k] / sum);
+                }
+            }
+        }
+    };
+
+    //==============================================================================
+    // Number of taps before the integer read index
+    template <InterpolationMode mode>
+    constexpr int getTapOffset(int band) {
+        if constexpr (mode == InterpolationMode::linear) return 0;
+        else if constexpr (mode == InterpolationMode::hermite) return 1;
+        else return SincTables::getNumTaps(band) / 2 - 1;
+    }
+
+    // Taps are stride samples apart, 1 for planar history and the channel count for interleaved
+    template <int stride = 1, typename Sample>
+    inline float linear(const Sample* x, float frac) {
+        const float x0 = (float)x[0];
+        return x0 + frac * ((float)x[stride] - x0);
+    }
+
+    // 4-point, 3rd-order Hermite. x points at the sample before the read index
+    inline float hermite(float x0, float x1, float x2, float x3, float frac) {
+        float c1 = 0.5f * (x2 - x0);
+        float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+        float c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+        return ((c3 * frac + c2) * frac + c1) * frac + x1;
+    }
+
+    template <int stride = 1, typename Sample>
+    inline float hermite(const Sample* x, float frac) {
+        return hermite((float)x[0], (float)x[stride], (float)x[2 * stride], (float)x[3 * stride], frac);
+    }
+
+    // Four consecutive taps as floats. Strided loads take the even samples of a double-width load, so for
+    // the right channel they touch half a frame past the last tap.
+   #if defined(INTERPOLATION_SSE)
+    template <int stride>
+    inline __m128 loadTaps(const float* x) {
+        static_assert(stride == 1 || stride == 2);
+        if constexpr (stride == 1) return _mm_loadu_ps(x);
+        else return _mm_shuffle_ps(_mm_loadu_ps(x), _mm_loadu_ps(x + 4), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    template <int stride>
+    inline __m128 loadTaps(const int16_t* x) {
+        static_assert(stride == 1 || stride == 2);
+
+        if constexpr (stride == 1) {
+            // Each value lands in both halves of a 32-bit lane, the arithmetic shift sign-extends it
+            __m128i v = _mm_loadl_epi64((const __m128i*)x);
+            return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        }
+        else {
+            // Every 32-bit lane starts with a tap
+            __m128i v = _mm_loadu_si128((const __m128i*)x);
+            return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 16), 16));
+        }
+    }
+   #elif defined(INTERPOLATION_NEON)
+    template <int stride>
+    inline float32x4_t loadTaps(const float* x) {
+        static_assert(stride == 1 || stride == 2);
+        if constexpr (stride == 1) return vld1q_f32(x);
+        else return vld2q_f32(x).val[0];
+    }
+
+    template <int stride>
+    inline float32x4_t loadTaps(const int16_t* x) {
+        static_assert(stride == 1 || stride == 2);
+        if constexpr (stride == 1) return vcvtq_f32_s32(vmovl_s16(vld1_s16(x)));
+        else return vcvtq_f32_s32(vmovl_s16(vld2_s16(x).val[0]));
+    }
+   #endif
+
+    // Dot product of the taps with two adjacent phase rows, blended by the fraction between phases
+    template <int stride = 1, typename Sample>
+    inline float sinc(const Sample* x, float frac, int band) {
+        const auto& tables = SincTables::getInstance();
+        const int taps = SincTables::getNumTaps(band);
+
+        float phasePos = frac * (float)SincTables::numPhases;
+        int phase = std::min((int)phasePos, SincTables::numPhases - 1);
+        float phaseFrac = phasePos - (float)phase;
+
+        const float* r0 = tables.getRow(band, phase);
+        const float* r1 = r0 + taps;
+
+       #if defined(INTERPOLATION_SSE)
+        __m128 a0 = _mm_setzero_ps();
+        __m128 a1 = _mm_setzero_ps();
+
+        for (int k = 0; k < taps; k += 4) {
+            __m128 v = loadTaps<stride>(x + k * stride);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(v, _mm_loadu_ps(r0 + k)));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(v, _mm_loadu_ps(r1 + k)));
+        }
+
+        __m128 blended = _mm_add_ps(a0, _mm_mul_ps(_mm_set1_ps(phaseFrac), _mm_sub_ps(a1, a0)));
+        __m128 sum = _mm_add_ps(blended, _mm_movehl_ps(blended, blended));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+       #elif defined(INTERPOLATION_NEON)
+        float32x4_t a0 = vdupq_n_f32(0.0f);
+        float32x4_t a1 = vdupq_n_f32(0.0f);
+
+        for (int k = 0; k < taps; k += 4) {
+            float32x4_t v = loadTaps<stride>(x + k * stride);
+            a0 = vmlaq_f32(a0, v, vld1q_f32(r0 + k));
+            a1 = vmlaq_f32(a1, v, vld1q_f32(r1 + k));
+        }
+
+        return vaddvq_f32(vmlaq_n_f32(a0, vsubq_f32(a1, a0), phaseFrac));
+       #else
+        float a0 = 0.0f, a1 = 0.0f;
+
+        for (int k = 0; k < taps; ++k) {
+            a0 += (float)x[k * stride] * r0[k];
+            a1 += (float)x[k * stride] * r1[k];
+        }
+
+        return a0 + phaseFrac * (a1 - a0);
+       #endif
+    }
+
+    // Read at index + frac from a history buffer of mask + 1 samples plus maxTaps mirrored guard samples,
+    // with consecutive samples stride apart. band is only used by sinc, see SincTables::getBand.
+    template <InterpolationMode mode, int stride = 1, typename Sample>
+    inline float read(const Sample* history, int mask, int32_t index, float frac, int band) {
+        const Sample* x = history + ((index - getTapOffset<mode>(band)) & mask) * stride;
+        constexpr float scale = getSampleScale<Sample>();
+
+        if constexpr (mode == InterpolationMode::linear) return linear<stride>(x, frac) * scale;
+        else if constexpr (mode == InterpolationMode::hermite) return hermite<stride>(x, frac) * scale;
+        else return sinc<stride>(x, frac, band) * scale;
+    }
+
+    // Both channels at one position of interleaved stereo history. Float linear and Hermite taps of the two
+    // channels arrive together, one vector per pair of frames, and are filtered side by side.
+    template <InterpolationMode mode, typename Sample>
+    inline StereoSample readStereo(const Sample* frames, int mask, int32_t index, float frac, int band) {
+       #if defined(INTERPOLATION_SSE)
+        if constexpr (std::is_same_v<Sample, float> && mode != InterpolationMode::sinc) {
+            const float* x = frames + ((index - getTapOffset<mode>(band)) & mask) * 2;
+            const __m128 f = _mm_set1_ps(frac);
+
+            // Lanes are { left, right, left, right }, only the low pair is used
+            __m128 a = _mm_loadu_ps(x);
+            __m128 x0 = a;
+            __m128 x1 = _mm_movehl_ps(a, a);
+            __m128 result;
+
+            if constexpr (mode == InterpolationMode::linear) {
+                result = _mm_add_ps(x0, _mm_mul_ps(f, _mm_sub_ps(x1, x0)));
+            }
+            else {
+                __m128 b = _mm_loadu_ps(x + 4);
+                __m128 x2 = b;
+                __m128 x3 = _mm_movehl_ps(b, b);
+
+                __m128 c1 = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x2, x0));
+                __m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(x0, _mm_mul_ps(_mm_set1_ps(2.5f), x1)), _mm_mul_ps(_mm_set1_ps(2.0f), x2)),
+                                       _mm_mul_ps(_mm_set1_ps(0.5f), x3));
+                __m128 c3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x3, x0)),
+                                       _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(x1, x2)));
+                result = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, f), c2), f), c1), f), x1);
+            }
+
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, result);
+            return { lanes[0], lanes[1] };
+        }
+       #elif defined(INTERPOLATION_NEON)
+        if constexpr (std::is_same_v<Sample, float> && mode == InterpolationMode::linear) {
+            const float* x = frames + (index & mask) * 2;
+            float32x2_t x0 = vld1_f32(x);
+            float32x2_t x1 = vld1_f32(x + 2);
+            float32x2_t result = vmla_n_f32(x0, vsub_f32(x1, x0), frac);
+            return { vget_lane_f32(result, 0), vget_lane_f32(result, 1) };
+        }
+       #endif
+
+        // Everything else reads the channels one after the other, still out of the same cache lines
+        return { read<mode, 2>(frames, mask, index, frac, band), read<mode, 2>(frames + 1, mask, index, frac, band) };
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+
+// Every parameter of the processor, in the order they are laid out. The processor keeps one raw value
+// pointer per entry, so the audio thread indexes an array instead of looking strings up. Binary
+// snapshots are stored in this order too, so new parameters only ever go at the end.
+enum class ParamID {
+    splice,
+    delay,
+    density,
+    pitch,
+    spread,
+    width,
+    feedback,
+    tone,
+    mix,
+    reverse,
+    envelope,
+    interpolation,
+    steal,
+    pitchOffset,
+    spliceOffset,
+    delayOffset,
+    seed,
+    morph,
+    densityMultiplier,
+    numParams
+};
+
+namespace ParameterIDs {
+    constexpr int numParams = (int)ParamID::numParams;
+
+    // Saved in presets and host automation, so existing IDs must never change
+    constexpr std::array<const char*, numParams> ids {
+        "splice",
+        "delay",
+        "density",
+        "pitch",
+        "spread",
+        "width",
+        "feedback",
+        "tone",
+        "mix",
+        "reverse",
+        "envelope",
+        "interpolation",
+        "steal",
+        "pitchOffset",
+        "spliceOffset",
+        "delayOffset",
+        "seed",
+        "morph",
+        "densityMultiplier"
+    };
+
+    constexpr const char* get(ParamID param) { return ids[(size_t)param]; }
+
+    // Switches, choices and the seed, which take one value or the other rather than anything in between
+    constexpr bool isDiscrete(ParamID param) {
+        return param == ParamID::reverse || param == ParamID::envelope || param == ParamID::interpolation
+            || param == ParamID::steal || param == ParamID::seed || param == ParamID::densityMultiplier;
+    }
+}
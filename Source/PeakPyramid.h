@@ -0,0 +1,226 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include "CircularBuffer.h"
+
+// Min/max summary of the history buffer at a few fixed resolutions, so a view can draw any zoom level
+// from precomputed buckets instead of scanning audio. The audio thread folds each span in as it is
+// written. Only the finest level looks at samples, coarser levels merge whole buckets from the level below.
+// A bucket that is still filling holds its partial peak, so every level is current to within one finest bucket.
+class PeakPyramid {
+public:
+    static constexpr int numLevels = 3;
+    static constexpr std::array<int, numLevels> bucketSizes { 64, 512, 4096 };
+    static constexpr int numChannels = 2;
+
+    struct Peak {
+        float min = 0.0f;
+        float max = 0.0f;
+    };
+
+    // Buffer length must be a multiple of the coarsest bucket size. Allocates when the length changes,
+    // so not from the audio thread, and never while a view may be reading. Keeping the storage otherwise
+    // lets an open view read through a re-prepare.
+    void respace(int samples) {
+        jassert(samples % bucketSizes.back() == 0);
+
+        if (samples != size) {
+            size = samples;
+            allocate();
+        }
+
+        reset();
+    }
+
+    void reset() {
+        for (auto& level : levels)
+            for (auto& buckets : level)
+                for (int i = 0; i < buckets.numBuckets; ++i) {
+                    buckets.min[(size_t)i].store(0.0f, std::memory_order_relaxed);
+                    buckets.max[(size_t)i].store(0.0f, std::memory_order_relaxed);
+                }
+
+        for (auto& channel : pending)
+            channel.fill(empty());
+    }
+
+    // Folds the numSamples frames that were just written at writePos into the pyramid
+    void update(const CircularBuffer& buffer, int writePos, int numSamples) {
+        const int mask = size - 1;
+        const int finest = bucketSizes[0];
+
+        while (numSamples > 0) {
+            const int start = writePos & mask;
+
+            // Buckets never straddle the end of the buffer, so each run is contiguous
+            const int offset = start & (finest - 1);
+            const int run = std::min(numSamples, finest - offset);
+
+            const int stride = buffer.getStride();
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const auto range = buffer.getFormat() == HistoryFormat::int16
+                                 ? findMinAndMax(buffer.getCompactReadPointer(channel) + start * stride, run, stride)
+                                 : findMinAndMax(buffer.getReadPointer(channel) + start * stride, run, stride);
+
+                Peak& peak = pending[(size_t)channel][0];
+                peak.min = std::min(peak.min, range.getStart());
+                peak.max = std::max(peak.max, range.getEnd());
+            }
+
+            propagate(start, offset + run == finest);
+
+            writePos += run;
+            numSamples -= run;
+        }
+    }
+
+    // Follows CircularBuffer::copyHistory, from a pyramid of at most this length. A bucket the write
+    // position falls inside lands in both places its samples went to, so the one holding the oldest
+    // samples shows the newest ones too until they are overwritten. Never allocates.
+    void copyPeaks(const PeakPyramid& source, int writePos) {
+        jassert(size >= source.size && writePos < source.size);
+
+        const int shift = size - source.size;
+
+        for (int level = 0; level < numLevels; ++level) {
+            const int bucketSize = bucketSizes[(size_t)level];
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int bucket = 0; bucket < source.getNumBuckets(level); ++bucket) {
+                    const Peak peak = source.getPeak(level, channel, bucket);
+                    const int start = bucket * bucketSize;
+
+                    if (start < writePos) store(level, channel, start, peak);
+                    if (start + bucketSize > writePos) store(level, channel, start + shift, peak);
+                }
+        }
+
+        pending = source.pending;
+    }
+
+    int getSize() const { return size; }
+
+    // Reader side, safe from any thread. Buckets can be a span out of date relative to each other,
+    // which only ever shows up as one pixel column.
+    int getNumBuckets(int level) const { return levels[(size_t)level][0].numBuckets; }
+
+    Peak getPeak(int level, int channel, int bucket) const {
+        const auto& buckets = levels[(size_t)level][(size_t)channel];
+        return { buckets.min[(size_t)bucket].load(std::memory_order_relaxed),
+                 buckets.max[(size_t)bucket].load(std::memory_order_relaxed) };
+    }
+
+    // Peak over [startSample, endSample) wrapped into the buffer, using the coarsest level that still
+    // resolves the range. Costs at most bucketSizes[n + 1] / bucketSizes[n] bucket reads.
+    Peak getRangePeak(int channel, int startSample, int endSample) const {
+        const int length = std::max(1, endSample - startSample);
+
+        int level = 0;
+        while (level + 1 < numLevels && bucketSizes[(size_t)level + 1] <= length)
+            ++level;
+
+        const int bucketSize = bucketSizes[(size_t)level];
+        const int numBuckets = getNumBuckets(level);
+        const int first = startSample / bucketSize;
+        const int last = std::max(first + 1, endSample / bucketSize);
+
+        Peak result = getPeak(level, channel, first & (numBuckets - 1));
+        for (int bucket = first + 1; bucket < last; ++bucket)
+            result = merge(result, getPeak(level, channel, bucket & (numBuckets - 1)));
+
+        return result;
+    }
+
+private:
+    struct Buckets {
+        std::unique_ptr<std::atomic<float>[]> min;
+        std::unique_ptr<std::atomic<float>[]> max;
+        int numBuckets = 0;
+    };
+
+    std::array<std::array<Buckets, numChannels>, numLevels> levels;
+
+    // Per level, the peak of samples not yet merged into the level above
+    std::array<std::array<Peak, numLevels>, numChannels> pending;
+
+    int size = 0;
+
+    void allocate() {
+        for (int level = 0; level < numLevels; ++level) {
+            const int numBuckets = size / bucketSizes[(size_t)level];
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                auto& buckets = levels[(size_t)level][(size_t)channel];
+                buckets.numBuckets = numBuckets;
+                buckets.min.reset(new std::atomic<float>[(size_t)numBuckets]);
+                buckets.max.reset(new std::atomic<float>[(size_t)numBuckets]);
+            }
+        }
+    }
+
+    template <typename Sample>
+    static juce::Range<float> findMinAndMax(const Sample* samples, int numSamples, int stride) {
+        if constexpr (std::is_same_v<Sample, float>) {
+            if (stride == 1) return juce::FloatVectorOperations::findMinAndMax(samples, numSamples);
+        }
+
+        Sample low = samples[0];
+        Sample high = samples[0];
+
+        for (int i = 1; i < numSamples; ++i) {
+            low = std::min(low, samples[i * stride]);
+            high = std::max(high, samples[i * stride]);
+        }
+
+        constexpr float scale = Interpolation::getSampleScale<Sample>();
+        return { (float)low * scale, (float)high * scale };
+    }
+
+    static Peak empty() {
+        return { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+    }
+
+    void store(int level, int channel, int sample, const Peak& peak) {
+        auto& buckets = levels[(size_t)level][(size_t)channel];
+        const size_t bucket = (size_t)(sample / bucketSizes[(size_t)level]);
+        buckets.min[bucket].store(peak.min, std::memory_order_relaxed);
+        buckets.max[bucket].store(peak.max, std::memory_order_relaxed);
+    }
+
+    static Peak merge(const Peak& a, const Peak& b) {
+        return { std::min(a.min, b.min), std::max(a.max, b.max) };
+    }
+
+    // Publishes every bucket containing sample. Each written sample is held by exactly one pending level,
+    // so a bucket's peak is its own pending peak merged with everything pending below it. Once the finest
+    // bucket is done, every level it completes is cleared and the first open level keeps the result.
+    void propagate(int sample, bool bucketDone) {
+        const int bucketEnd = (sample & ~(bucketSizes[0] - 1)) + bucketSizes[0];
+
+        int closed = 0;
+        if (bucketDone) {
+            closed = 1;
+            while (closed < numLevels && (bucketEnd & (bucketSizes[(size_t)closed] - 1)) == 0)
+                ++closed;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& peaks = pending[(size_t)channel];
+            Peak running = empty();
+
+            for (int level = 0; level < numLevels; ++level) {
+                running = merge(running, peaks[(size_t)level]);
+                store(level, channel, sample, running);
+
+                if (level < closed)
+                    peaks[(size_t)level] = empty();
+                else if (level == closed)
+                    peaks[(size_t)level] = running;
+            }
+        }
+    }
+};
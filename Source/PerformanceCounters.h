@@ -0,0 +1,184 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <cstdint>
+
+// Running cost of the processor, written by the audio thread once per block and readable from any thread.
+// There is only ever one writer, so every update is a relaxed load and store with no read-modify-write
+// and no shared cache line traffic unless somebody is actually reading.
+class PerformanceCounters {
+public:
+    // Block time relative to the block's own duration in 10% steps, the last bin counts every overrun
+    static constexpr int numHistogramBins = 11;
+
+    struct Snapshot {
+        uint64_t blocks = 0;
+
+        double minBlockSeconds = 0.0;
+        double meanBlockSeconds = 0.0;
+        double maxBlockSeconds = 0.0;
+        double lastDeadlineSeconds = 0.0;
+        std::array<uint64_t, numHistogramBins> histogram {};
+
+        // Processing time as a fraction of realtime
+        double load = 0.0;     // Smoothed over about half a second
+        double meanLoad = 0.0; // Since the last reset
+        double peakLoad = 0.0; // Worst single block
+
+        int activeGrains = 0;
+        int peakActiveGrains = 0;
+        int grainCapacity = 0;
+        uint64_t grainsStolen = 0;
+        uint32_t collisions = 0;
+
+        // Blocks that took the silent input shortcut
+        uint64_t idleBlocks = 0;
+
+        uint64_t getOverruns() const { return histogram.back(); }
+    };
+
+    //==============================================================================
+    // Reader side. Values can come from neighbouring blocks but are never torn.
+    Snapshot getSnapshot() const {
+        Snapshot s;
+        const double tickSeconds = 1.0 / (double)juce::Time::getHighResolutionTicksPerSecond();
+
+        s.blocks = blocks.load(std::memory_order_relaxed);
+        if (s.blocks > 0) {
+            s.minBlockSeconds = (double)minTicks.load(std::memory_order_relaxed) * tickSeconds;
+            s.maxBlockSeconds = (double)maxTicks.load(std::memory_order_relaxed) * tickSeconds;
+            s.meanBlockSeconds = (double)totalTicks.load(std::memory_order_relaxed) * tickSeconds / (double)s.blocks;
+        }
+
+        s.lastDeadlineSeconds = lastDeadline.load(std::memory_order_relaxed);
+
+        for (size_t bin = 0; bin < histogram.size(); ++bin)
+            s.histogram[bin] = histogram[bin].load(std::memory_order_relaxed);
+
+        s.load = load.load(std::memory_order_relaxed);
+        s.peakLoad = peakLoad.load(std::memory_order_relaxed);
+
+        const double audioSeconds = totalAudioSeconds.load(std::memory_order_relaxed);
+        if (audioSeconds > 0.0)
+            s.meanLoad = (double)totalTicks.load(std::memory_order_relaxed) * tickSeconds / audioSeconds;
+
+        s.activeGrains = activeGrains.load(std::memory_order_relaxed);
+        s.peakActiveGrains = peakActiveGrains.load(std::memory_order_relaxed);
+        s.grainCapacity = grainCapacity.load(std::memory_order_relaxed);
+        s.grainsStolen = grainsStolen.load(std::memory_order_relaxed);
+        s.collisions = collisions.load(std::memory_order_relaxed);
+        s.idleBlocks = idleBlocks.load(std::memory_order_relaxed);
+
+        return s;
+    }
+
+    // Clears the running statistics, taking effect at the end of the next block
+    void requestReset() { resetRequested.store(true, std::memory_order_relaxed); }
+
+    //==============================================================================
+    // Audio thread
+    void prepare(double newSampleRate, uint32_t collisionCount) {
+        sampleRate = newSampleRate;
+        clear();
+        collisionBase = collisionCount;
+    }
+
+    void addStolenGrain() { ++pendingStolen; }
+    void addIdleBlock() { ++pendingIdleBlocks; }
+
+    void endBlock(juce::int64 startTicks, int numSamples, int numActiveGrains, int capacity, uint32_t collisionCount) {
+        const juce::int64 elapsed = juce::Time::getHighResolutionTicks() - startTicks;
+
+        if (resetRequested.load(std::memory_order_relaxed) && resetRequested.exchange(false, std::memory_order_relaxed)) {
+            clear();
+            collisionBase = collisionCount;
+        }
+
+        if (numSamples <= 0 || sampleRate <= 0.0) return;
+
+        const double deadline = (double)numSamples / sampleRate;
+        const double blockLoad = juce::Time::highResolutionTicksToSeconds(elapsed) / deadline;
+
+        const uint64_t count = blocks.load(std::memory_order_relaxed);
+        if (count == 0 || elapsed < minTicks.load(std::memory_order_relaxed)) minTicks.store(elapsed, std::memory_order_relaxed);
+        if (elapsed > maxTicks.load(std::memory_order_relaxed)) maxTicks.store(elapsed, std::memory_order_relaxed);
+        totalTicks.store(totalTicks.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        totalAudioSeconds.store(totalAudioSeconds.load(std::memory_order_relaxed) + deadline, std::memory_order_relaxed);
+        blocks.store(count + 1, std::memory_order_relaxed);
+        lastDeadline.store(deadline, std::memory_order_relaxed);
+
+        auto& bin = histogram[(size_t)juce::jlimit(0, numHistogramBins - 1, (int)(blockLoad * 10.0))];
+        bin.store(bin.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        const double smoothing = juce::jmin(1.0, deadline / loadSmoothingSeconds);
+        const double smoothed = load.load(std::memory_order_relaxed);
+        load.store(smoothed + smoothing * (blockLoad - smoothed), std::memory_order_relaxed);
+        if (blockLoad > peakLoad.load(std::memory_order_relaxed)) peakLoad.store(blockLoad, std::memory_order_relaxed);
+
+        activeGrains.store(numActiveGrains, std::memory_order_relaxed);
+        if (numActiveGrains > peakActiveGrains.load(std::memory_order_relaxed)) peakActiveGrains.store(numActiveGrains, std::memory_order_relaxed);
+        grainCapacity.store(capacity, std::memory_order_relaxed);
+
+        if (pendingStolen > 0) {
+            grainsStolen.store(grainsStolen.load(std::memory_order_relaxed) + pendingStolen, std::memory_order_relaxed);
+            pendingStolen = 0;
+        }
+
+        if (pendingIdleBlocks > 0) {
+            idleBlocks.store(idleBlocks.load(std::memory_order_relaxed) + pendingIdleBlocks, std::memory_order_relaxed);
+            pendingIdleBlocks = 0;
+        }
+
+        collisions.store(collisionCount - collisionBase, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr double loadSmoothingSeconds = 0.5;
+
+    double sampleRate = 0.0;
+    uint64_t pendingStolen = 0;
+    uint64_t pendingIdleBlocks = 0;
+
+    // The processor's collision count keeps running, so resets only move the baseline
+    uint32_t collisionBase = 0;
+
+    std::atomic<bool> resetRequested { false };
+
+    std::atomic<uint64_t> blocks { 0 };
+    std::atomic<juce::int64> minTicks { 0 };
+    std::atomic<juce::int64> maxTicks { 0 };
+    std::atomic<juce::int64> totalTicks { 0 };
+    std::atomic<double> totalAudioSeconds { 0.0 };
+    std::atomic<double> lastDeadline { 0.0 };
+    std::array<std::atomic<uint64_t>, numHistogramBins> histogram {};
+
+    std::atomic<double> load { 0.0 };
+    std::atomic<double> peakLoad { 0.0 };
+
+    std::atomic<int> activeGrains { 0 };
+    std::atomic<int> peakActiveGrains { 0 };
+    std::atomic<int> grainCapacity { 0 };
+    std::atomic<uint64_t> grainsStolen { 0 };
+    std::atomic<uint32_t> collisions { 0 };
+    std::atomic<uint64_t> idleBlocks { 0 };
+
+    void clear() {
+        blocks.store(0, std::memory_order_relaxed);
+        minTicks.store(0, std::memory_order_relaxed);
+        maxTicks.store(0, std::memory_order_relaxed);
+        totalTicks.store(0, std::memory_order_relaxed);
+        totalAudioSeconds.store(0.0, std::memory_order_relaxed);
+
+        for (auto& bin : histogram)
+            bin.store(0, std::memory_order_relaxed);
+
+        load.store(0.0, std::memory_order_relaxed);
+        peakLoad.store(0.0, std::memory_order_relaxed);
+        peakActiveGrains.store(0, std::memory_order_relaxed);
+        grainsStolen.store(0, std::memory_order_relaxed);
+        pendingStolen = 0;
+        idleBlocks.store(0, std::memory_order_relaxed);
+        pendingIdleBlocks = 0;
+    }
+};
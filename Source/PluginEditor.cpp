@@ -2,18 +2,23 @@
 #include "PluginEditor.h"
 
 void AudioPluginAudioProcessorEditor::timerCallback() {
-    waveformVisualizer.processorBuffer = &processorRef.circularBuffer;
-    waveformVisualizer.grainPool = &processorRef.grainPool;
-    waveformVisualizer.currentWritePos = processorRef.writePos;
+    waveformVisualizer.peaks = processorRef.getPeakPyramid();
 
-    if (processorRef.rightChannelCollision.load()) {
-        float s = processorRef.rightChannelCollisionSamples.load();
-        collisionSamplesText = std::max(s, collisionSamplesText);
+    if (processorRef.telemetry.update())
+        waveformVisualizer.frame = &processorRef.telemetry.getReadBuffer();
+
+    const auto* frame = waveformVisualizer.frame;
+
+    const bool wasTriggered = collisionVisualTrigger;
+    const bool wasDecaying = collisionDecay > 0;
+    const float previousText = collisionSamplesText;
+
+    if (frame != nullptr && frame->collisionCount != lastCollisionCount) {
+        lastCollisionCount = frame->collisionCount;
+        collisionSamplesText = std::max(frame->lastCollisionSamples, collisionSamplesText);
 
         collisionVisualTrigger = true;
         collisionDecay = 12;
-        
-        processorRef.rightChannelCollision.store(false);
     } 
     else if (collisionDecay > 0) {
         collisionDecay--;
@@ -21,15 +26,263 @@ void AudioPluginAudioProcessorEditor::timerCallback() {
     } 
     else {
         collisionSamplesText = 0.0f;
-        processorRef.rightChannelCollisionSamples = 0.0f;
     }
 
+    waveformVisualizer.update();
+
+    // A readable rate for numbers, and nothing is queried while the overlay is hidden
+    if (performanceOverlay.isVisible() && ++performanceTicks >= 6) {
+        performanceTicks = 0;
+        performanceOverlay.stats = processorRef.getPerformanceStats();
+        performanceOverlay.repaint();
+    }
+
+    // The editor itself only draws the collision indicator
+    if (wasTriggered != collisionVisualTrigger || wasDecaying != (collisionDecay > 0) || previousText != collisionSamplesText)
+        repaint();
+}
+
+//==============================================================================
+void AudioPluginAudioProcessorEditor::WaveformVisualizer::resized() {
+    waveformImage = juce::Image(juce::Image::ARGB, juce::jmax(1, getWidth()), juce::jmax(1, getHeight()), true);
+    imageValid = false;
+}
+
+void AudioPluginAudioProcessorEditor::WaveformVisualizer::renderColumns(int firstColumn, int numColumns) {
+    const int imageWidth = waveformImage.getWidth();
+    const int imageHeight = waveformImage.getHeight();
+    const int totalSamples = peaks->getSize();
 
-    waveformVisualizer.repaint();
-    repaint();
+    const float midY = (float)imageHeight / 2.0f;
+    const float samplesPerPixel = (float)totalSamples / (float)imageWidth;
+
+    auto scale = [](float boost, float val) {
+        if (val == 0) return 0.0f;
+        return std::pow(std::abs(val), 1.0f - boost);
+    };
+
+    const float boostInner = -0.2f;
+    const float boostOuter = 0.5f;
+    const juce::Colour colourBackground = backgroundColour.overlaidWith(juce::Colours::black.withAlpha(0.5f));
+    const juce::Colour colourInner = juce::Colours::aquamarine.withAlpha(0.75f);
+    const juce::Colour colourOuter = juce::Colours::deepskyblue.withAlpha(0.35f);
+    const juce::Colour colourMidline = juce::Colours::white.withAlpha(0.15f);
+
+    juce::Graphics g(waveformImage);
+
+    for (int i = 0; i < std::min(numColumns, imageWidth); ++i) {
+        const int x = (firstColumn + i) % imageWidth;
+
+        int startSample = (int)(x * samplesPerPixel);
+        int endSample = (int)((x + 1) * samplesPerPixel);
+
+        auto peakL = peaks->getRangePeak(0, startSample, endSample);
+        auto peakR = peaks->getRangePeak(1, startSample, endSample);
+
+        float maxL = std::max(std::abs(peakL.min), std::abs(peakL.max));
+        float maxR = std::max(std::abs(peakR.min), std::abs(peakR.max));
+
+        waveformImage.clear({ x, 0, 1, imageHeight }, colourBackground);
+
+        // L excursion
+        g.setColour(colourOuter);
+        g.drawVerticalLine(x, midY - (scale(boostOuter, maxL) * midY * 0.95f), midY);
+        g.setColour(colourInner);
+        g.drawVerticalLine(x, midY - (scale(boostInner, maxL) * midY * 0.95f), midY);
+
+        // R excursion
+        g.setColour(colourOuter);
+        g.drawVerticalLine(x, midY, midY + (scale(boostOuter, maxR) * midY * 0.95f));
+        g.setColour(colourInner);
+        g.drawVerticalLine(x, midY, midY + (scale(boostInner, maxR) * midY * 0.95f));
+
+        g.setColour(colourMidline);
+        g.drawHorizontalLine((int)midY, (float)x, (float)(x + 1));
+    }
 }
 
-void AudioPluginAudioProcessorEditor::setupKnob(juce::String paramID, juce::String paramName) {
+void AudioPluginAudioProcessorEditor::WaveformVisualizer::updateGrainOverlay() {
+    grainAreas.clear();
+    grainReadLines.clear();
+
+    if (frame == nullptr) return;
+
+    const int totalSamples = peaks->getSize();
+    const int mask = totalSamples - 1;
+    const float width = (float)getWidth();
+    const float height = (float)getHeight();
+    const float midY = height / 2.0f;
+    const float pixelPerSample = width / (float)totalSamples;
+
+    auto addGrain = [&](const GrainSnapshot& grain, int channel, float yStart, float yEnd) {
+        const int grainLenSamples = grain.totalSamples[(size_t)channel];
+        if (grainLenSamples <= 0) return;
+
+        const float readPos = grain.readPosition[(size_t)channel];
+        const float pitchStep = grain.pitchStep[(size_t)channel];
+        const float direction = grain.reverse ? -1.0f : 1.0f;
+
+        float distanceCovered = grain.progress[(size_t)channel] * (float)grainLenSamples * pitchStep;
+
+        float startSampleRaw = readPos - (distanceCovered * direction);
+        if (direction < 0.0f) startSampleRaw -= ((float)grainLenSamples * pitchStep);
+
+        int startSampleWrapped = (int)(startSampleRaw) & mask;
+
+        float xStart = (float)startSampleWrapped * pixelPerSample;
+        float xWidth = ((float)grainLenSamples * pitchStep) * pixelPerSample;
+        float xReadPos = (float)((int)readPos & mask) * pixelPerSample;
+
+        if (xStart + xWidth > width) {
+            grainAreas.emplace_back(xStart, yStart, width - xStart, yEnd - yStart);
+            grainAreas.emplace_back(0.0f, yStart, xWidth - (width - xStart), yEnd - yStart);
+        }
+        else {
+            grainAreas.emplace_back(xStart, yStart, xWidth, yEnd - yStart);
+        }
+
+        grainReadLines.emplace_back(std::floor(xReadPos), yStart, 1.0f, yEnd - yStart);
+    };
+
+    for (int i = 0; i < frame->numGrains; ++i) {
+        const auto& grain = frame->grains[(size_t)i];
+        addGrain(grain, 0, 0.0f, midY);
+        addGrain(grain, 1, midY, height);
+    }
+}
+
+void AudioPluginAudioProcessorEditor::WaveformVisualizer::update() {
+    if (peaks == nullptr || peaks->getSize() == 0 || waveformImage.isNull()) return;
+
+    const int totalSamples = peaks->getSize();
+
+    // A re-prepared or grown history is drawn afresh
+    if (totalSamples != imageSize) {
+        imageSize = totalSamples;
+        imageValid = false;
+    }
+
+    const int mask = totalSamples - 1;
+    const int imageWidth = waveformImage.getWidth();
+    const int imageHeight = waveformImage.getHeight();
+    const int writePos = frame != nullptr ? (frame->writePos & mask) : 0;
+
+    auto columnOf = [&](int sample) {
+        return juce::jmin(imageWidth - 1, (int)((juce::int64)sample * imageWidth / totalSamples));
+    };
+
+    if (!imageValid) {
+        renderColumns(0, imageWidth);
+        imageValid = true;
+        lastWritePos = writePos;
+        playheadX = columnOf(writePos);
+        updateGrainOverlay();
+        repaint();
+        return;
+    }
+
+    // Columns covering everything written since the last frame, up to the one still being written
+    if (writePos != lastWritePos) {
+        const int firstColumn = columnOf(lastWritePos);
+        const int numColumns = ((columnOf(writePos) - firstColumn + imageWidth) % imageWidth) + 1;
+
+        renderColumns(firstColumn, numColumns);
+
+        const int endColumn = firstColumn + numColumns;
+        repaint(firstColumn, 0, std::min(endColumn, imageWidth) - firstColumn, imageHeight);
+        if (endColumn > imageWidth)
+            repaint(0, 0, endColumn - imageWidth, imageHeight);
+
+        lastWritePos = writePos;
+    }
+
+    const int newPlayheadX = columnOf(writePos);
+    if (newPlayheadX != playheadX) {
+        repaint(playheadX, 0, 1, imageHeight);
+        repaint(newPlayheadX, 0, 1, imageHeight);
+        playheadX = newPlayheadX;
+    }
+
+    // Grains move every frame, so repaint wherever they were and wherever they are now
+    const auto previousGrainBounds = grainBounds;
+    updateGrainOverlay();
+
+    juce::Rectangle<float> bounds;
+    for (const auto& area : grainAreas) bounds = bounds.getUnion(area);
+    for (const auto& line : grainReadLines) bounds = bounds.getUnion(line);
+    grainBounds = bounds.getSmallestIntegerContainer();
+
+    const auto dirty = previousGrainBounds.getUnion(grainBounds);
+    if (!dirty.isEmpty())
+        repaint(dirty);
+}
+
+void AudioPluginAudioProcessorEditor::WaveformVisualizer::paint(juce::Graphics& g) {
+    if (!imageValid) {
+        g.fillAll(backgroundColour.overlaidWith(juce::Colours::black.withAlpha(0.5f)));
+        return;
+    }
+
+    g.drawImageAt(waveformImage, 0, 0);
+
+    // Grain playheads & bounds
+    g.setColour(juce::Colours::white.withAlpha(0.015f));
+    for (const auto& area : grainAreas)
+        g.fillRect(area);
+
+    g.setColour(juce::Colours::white.withAlpha(0.15f));
+    for (const auto& line : grainReadLines)
+        g.fillRect(line);
+
+    // Playhead
+    g.setColour(juce::Colours::red.withAlpha(0.4f));
+    g.drawVerticalLine(playheadX, 0.0f, (float)getHeight());
+}
+
+void AudioPluginAudioProcessorEditor::PerformanceOverlay::paint(juce::Graphics& g) {
+    g.fillAll(juce::Colours::black.withAlpha(0.7f));
+
+    auto area = getLocalBounds().reduced(8, 4);
+    auto histogramArea = area.removeFromRight(area.getWidth() / 4).reduced(0, 4);
+
+    auto micros = [](double seconds) { return juce::String(seconds * 1.0e6, 0) + " us"; };
+    auto percent = [](double fraction) { return juce::String(fraction * 100.0, 1) + "%"; };
+
+    const juce::String lines[] = {
+        "Block " + micros(stats.minBlockSeconds) + " / " + micros(stats.meanBlockSeconds) + " / " + micros(stats.maxBlockSeconds)
+            + " (min / mean / max) of " + micros(stats.lastDeadlineSeconds),
+        "Load " + percent(stats.load) + ", mean " + percent(stats.meanLoad) + ", peak " + percent(stats.peakLoad),
+        "Grains " + juce::String(stats.activeGrains) + " / " + juce::String(stats.grainCapacity)
+            + ", peak " + juce::String(stats.peakActiveGrains) + ", stolen " + juce::String((juce::int64)stats.grainsStolen),
+        "Collisions " + juce::String((juce::int64)stats.collisions) + ", overruns " + juce::String((juce::int64)stats.getOverruns())
+            + ", idle " + percent(stats.blocks > 0 ? (double)stats.idleBlocks / (double)stats.blocks : 0.0)
+    };
+
+    g.setColour(juce::Colours::white.withAlpha(0.85f));
+    g.setFont(12.0f);
+
+    const int lineHeight = area.getHeight() / (int)std::size(lines);
+    for (const auto& line : lines)
+        g.drawText(line, area.removeFromTop(lineHeight), juce::Justification::centredLeft);
+
+    // Block time histogram in 10% steps of the deadline, overruns in red
+    uint64_t tallest = 1;
+    for (auto count : stats.histogram)
+        tallest = std::max(tallest, count);
+
+    const float barWidth = (float)histogramArea.getWidth() / (float)PerformanceCounters::numHistogramBins;
+
+    for (int bin = 0; bin < PerformanceCounters::numHistogramBins; ++bin) {
+        const float barHeight = (float)histogramArea.getHeight() * (float)stats.histogram[(size_t)bin] / (float)tallest;
+        const bool overrun = bin == PerformanceCounters::numHistogramBins - 1;
+
+        g.setColour(overrun ? juce::Colours::red.withAlpha(0.8f) : juce::Colours::aquamarine.withAlpha(0.6f));
+        g.fillRect((float)histogramArea.getX() + (float)bin * barWidth, (float)histogramArea.getBottom() - barHeight,
+                   barWidth - 1.0f, barHeight);
+    }
+}
+
+void AudioPluginAudioProcessorEditor::setupKnob(ParamID paramID, juce::String paramName) {
     auto component = std::make_unique<GuiComponent>();
 
     component->slider.setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
@@ -41,19 +294,36 @@ void AudioPluginAudioProcessorEditor::setupKnob(juce::String paramID, juce::Stri
     addAndMakeVisible(component->label);
 
     component->sliderAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(
-        processorRef.apvts, paramID, component->slider);
+        processorRef.apvts, ParameterIDs::get(paramID), component->slider);
 
     guiComponents.push_back(std::move(component));
 }
 
-void AudioPluginAudioProcessorEditor::setupToggle(juce::String paramID, juce::String buttonText) {
+void AudioPluginAudioProcessorEditor::setupToggle(ParamID paramID, juce::String buttonText) {
     auto component = std::make_unique<GuiComponent>();
 
     component->reverseButton.setButtonText(buttonText);
     addAndMakeVisible(component->reverseButton);
 
     component->buttonAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(
-        processorRef.apvts, paramID, component->reverseButton);
+        processorRef.apvts, ParameterIDs::get(paramID), component->reverseButton);
+
+    guiComponents.push_back(std::move(component));
+}
+
+void AudioPluginAudioProcessorEditor::setupChoice(ParamID paramID, juce::String paramName, const juce::StringArray& choices) {
+    auto component = std::make_unique<GuiComponent>();
+
+    // Items must exist before the attachment syncs the selection
+    component->comboBox.addItemList(choices, 1);
+    addAndMakeVisible(component->comboBox);
+
+    component->label.setText(paramName, juce::dontSendNotification);
+    component->label.setJustificationType(juce::Justification::centred);
+    addAndMakeVisible(component->label);
+
+    component->comboBoxAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(
+        processorRef.apvts, ParameterIDs::get(paramID), component->comboBox);
 
     guiComponents.push_back(std::move(component));
 }
@@ -63,34 +333,52 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     juce::ignoreUnused (processorRef);
 
     addAndMakeVisible(waveformVisualizer);
+    addChildComponent(performanceOverlay);
+
+    performanceButton.setButtonText("Stats");
+    performanceButton.setClickingTogglesState(true);
+    performanceButton.onClick = [this] {
+        performanceTicks = 6;
+        performanceOverlay.setVisible(performanceButton.getToggleState());
+    };
+    addAndMakeVisible(performanceButton);
+
+    setupKnob(ParamID::splice, "Splice (ms)");
+    setupKnob(ParamID::delay, "Delay (ms)");
+    setupKnob(ParamID::density, "Density");
+    setupKnob(ParamID::pitch, "Pitch");
+    setupKnob(ParamID::spread, "Spread (s)");
+    setupKnob(ParamID::feedback, "Feedback");
+    setupKnob(ParamID::width, "Width");
+    setupKnob(ParamID::tone, "Tone");
+    setupKnob(ParamID::mix, "Mix");
 
-    setupKnob("splice", "Splice (ms)");
-    setupKnob("delay", "Delay (ms)");
-    setupKnob("density", "Density");
-    setupKnob("pitch", "Pitch");
-    setupKnob("spread", "Spread (s)");
-    setupKnob("feedback", "Feedback");
-    setupKnob("width", "Width");
-    setupKnob("tone", "Tone");
-    setupKnob("mix", "Mix");
+    setupKnob(ParamID::spliceOffset, "Splice Offset (%)");
+    setupKnob(ParamID::delayOffset, "Delay Offset (%)");
+    setupKnob(ParamID::pitchOffset, "Pitch Offset (cents)");
+    setupKnob(ParamID::seed, "Seed");
+    setupKnob(ParamID::morph, "Morph");
 
-    setupKnob("spliceOffset", "Splice Offset (%)");
-    setupKnob("delayOffset", "Delay Offset (%)");
-    setupKnob("pitchOffset", "Pitch Offset (cents)");
+    setupToggle(ParamID::reverse, "Reverse");
+    setupChoice(ParamID::envelope, "Envelope", WindowTables::getShapeNames());
+    setupChoice(ParamID::interpolation, "Interpolation", Interpolation::getModeNames());
+    setupChoice(ParamID::steal, "Stealing", GrainPool::getStealPolicyNames());
+    setupChoice(ParamID::densityMultiplier, "Density Range", AudioPluginAudioProcessor::getDensityMultiplierNames());
 
-    setupToggle("reverse", "Reverse");
+    setSize (700, 540);
 
-    setSize (700, 450);
+    processorRef.setTelemetryEnabled(true);
     startTimerHz(60);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor() {
     stopTimer();
+    processorRef.setTelemetryEnabled(false);
 }
 
 //==============================================================================
 void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g) {
-    g.fillAll (juce::Colour (0xff0B0C0D));
+    g.fillAll (backgroundColour);
 
     g.setColour(juce::Colour (0x88ffffff));
     if (collisionDecay > 0) {
@@ -112,11 +400,13 @@ void AudioPluginAudioProcessorEditor::resized() {
 
     auto waveformArea = area.removeFromTop(80); 
     waveformVisualizer.setBounds(waveformArea);
+    performanceOverlay.setBounds(waveformArea);
+    performanceButton.setBounds(getLocalBounds().removeFromTop(20).withTrimmedRight(20).removeFromRight(60).reduced(0, 2));
     
     area.removeFromTop(20);
     
     const int cols = 5;
-    const int rows = 3;
+    const int rows = ((int)guiComponents.size() + cols - 1) / cols;
     const int width = area.getWidth() / cols;
     const int height = area.getHeight() / rows;
 
@@ -136,6 +426,10 @@ void AudioPluginAudioProcessorEditor::resized() {
         else if (guiComponents[i]->reverseButton.isVisible()) {
             guiComponents[i]->reverseButton.setBounds(slot.reduced(10, 20));
         }
+        else if (guiComponents[i]->comboBox.isVisible()) {
+            guiComponents[i]->label.setBounds(slot.removeFromTop(20));
+            guiComponents[i]->comboBox.setBounds(slot.reduced(5).withSizeKeepingCentre(slot.getWidth() - 10, 24));
+        }
     }
 }
 
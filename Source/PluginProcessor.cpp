@@ -5,7 +5,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
     juce::AudioProcessorValueTreeState::ParameterLayout layout;
 
     auto addFloat = [&](
-        const juce::String& id, 
+        ParamID id, 
         const juce::String& name, 
         float min, 
         float max, 
@@ -15,72 +15,45 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
         bool symmetric = false
     ) {
         layout.add(std::make_unique<juce::AudioParameterFloat>(
-            id, 
+            ParameterIDs::get(id), 
             name, 
             juce::NormalisableRange<float>(min, max, step, skew, symmetric), 
             def
         ));
     };
 
-    addFloat("splice", "Splice (ms)", 0.10f, 2000.0f, 0.1f, 600.0f, 0.3f);
-    addFloat("delay", "Delay (ms)", 0.0f, 1000.0f, 0.1f, 150.0f, 0.3f);
-    addFloat("density", "Density", 1.0f, 32.0f, 0.1f, 2.0f);
-    addFloat("pitch", "Pitch", 0.25f, 4.0f, 0.0f, 2.0f, 1.0f, true);
-    addFloat("spread", "Spread (ms)", 0.0f, 500.0f, 0.1f, 150.0f, 0.3f);
+    addFloat(ParamID::splice, "Splice (ms)", 0.10f, 2000.0f, 0.1f, 600.0f, 0.3f);
+    addFloat(ParamID::delay, "Delay (ms)", 0.0f, 1000.0f, 0.1f, 150.0f, 0.3f);
+    addFloat(ParamID::density, "Density", 1.0f, 32.0f, 0.1f, 2.0f);
+    addFloat(ParamID::pitch, "Pitch", 0.25f, 4.0f, 0.0f, 2.0f, 1.0f, true);
+    addFloat(ParamID::spread, "Spread (ms)", 0.0f, 500.0f, 0.1f, 150.0f, 0.3f);
 
-    addFloat("width", "Width", 0.0f, 1.0f, 0.01f, 1.0f);
-    addFloat("feedback", "Feedback", 0.0f, 1.0f, 0.01f, 0.75f);
-    addFloat("tone", "Tone", 0.0f, 1.0f, 0.01f, 0.9f);
-    addFloat("mix", "Mix", 0.0f, 1.0f, 0.01f, 0.5f);
+    addFloat(ParamID::width, "Width", 0.0f, 1.0f, 0.01f, 1.0f);
+    addFloat(ParamID::feedback, "Feedback", 0.0f, 1.0f, 0.01f, 0.75f);
+    addFloat(ParamID::tone, "Tone", 0.0f, 1.0f, 0.01f, 0.9f);
+    addFloat(ParamID::mix, "Mix", 0.0f, 1.0f, 0.01f, 0.5f);
 
-    layout.add(std::make_unique<juce::AudioParameterBool>("reverse", "Reverse", true));
+    layout.add(std::make_unique<juce::AudioParameterBool>(ParameterIDs::get(ParamID::reverse), "Reverse", true));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterIDs::get(ParamID::envelope), "Envelope Shape", WindowTables::getShapeNames(), WindowTables::hann));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterIDs::get(ParamID::interpolation), "Interpolation", Interpolation::getModeNames(), (int)InterpolationMode::linear));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterIDs::get(ParamID::steal), "Voice Stealing", GrainPool::getStealPolicyNames(), (int)GrainPool::StealPolicy::oldest));
 
-    addFloat("pitchOffset", "Pitch Offset (Cents)", 0.0f, 4800.0f, 1.0f, 0.0f);
-    addFloat("spliceOffset", "Splice Offset (%)", 0.0f, 99.0f, 1.0f, 0.0f);
-    addFloat("delayOffset", "Delay Offset (%)", 0.0f, 99.0f, 1.0f, 0.0f);
+    addFloat(ParamID::pitchOffset, "Pitch Offset (Cents)", 0.0f, 4800.0f, 1.0f, 0.0f);
+    addFloat(ParamID::spliceOffset, "Splice Offset (%)", 0.0f, 99.0f, 1.0f, 0.0f);
+    addFloat(ParamID::delayOffset, "Delay Offset (%)", 0.0f, 99.0f, 1.0f, 0.0f);
+
+    // 0 keeps the generator free running, anything else restarts it from that seed so renders repeat exactly
+    layout.add(std::make_unique<juce::AudioParameterInt>(ParameterIDs::get(ParamID::seed), "Seed", 0, 9999, 0));
+
+    // Only does anything while morph scenes are set
+    addFloat(ParamID::morph, "Morph", 0.0f, 1.0f, 0.001f, 0.0f);
+
+    // Scales density for clouds past its own range, a separate parameter so automation of density keeps its mapping
+    layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterIDs::get(ParamID::densityMultiplier), "Density Multiplier", getDensityMultiplierNames(), 0));
 
     return layout;
 }
 
-// void AudioPluginAudioProcessor::logGrainStats(const Grain& g) {
-//     juce::ScopedLock lock(logMutex);
-    
-//     bool errorL = g.actualSamplesReadL > g.expectedSamplesL;
-//     bool errorR = g.actualSamplesReadR > g.expectedSamplesR;
-//     bool hasError = errorL || errorR;
-    
-//     juce::String logEntry;
-    
-//     if (hasError) {
-//         logEntry << "[ERROR] ";
-//     }
-
-//     logEntry << "Grain started at buffer sample: " << g.startBufferSample << "\n";
-//     logEntry << "Initial finalBaseDelay: " << juce::String(g.initFinalBaseDelay, 4);
-//     logEntry << "Initial readPosR: " << juce::String(g.initReadPosR, 4);
-//     logEntry << "Initial writePos: " << g.initWritePos;
-//     logEntry << "writePos at collision: " << g.writePosAtCollision;
-
-//     logEntry << "  L channel - Expected: " << juce::String(g.expectedSamplesL, 2) 
-//              << " samples, Actual: " << juce::String(g.actualSamplesReadL, 2) << " samples";
-//     if (errorL) {
-//         logEntry << " [OVERREAD: " << juce::String(g.actualSamplesReadL - g.expectedSamplesL, 2) << "]";
-//     }
-//     logEntry << "\n";
-    
-//     logEntry << "  R channel - Expected: " << juce::String(g.expectedSamplesR, 2) 
-//              << " samples, Actual: " << juce::String(g.actualSamplesReadR, 2) << " samples";
-//     if (errorR) {
-//         logEntry << " [OVERREAD: " << juce::String(g.actualSamplesReadR - g.expectedSamplesR, 2) << "]";
-//     }
-//     if (g.collision) {
-//         logEntry << "[COLLISION DETECTED: " << juce::String(g.cs, 2) << "]";
-//     }
-//     logEntry << "\n\n";
-    
-//     logFile.appendText(logEntry);
-// }
-
 //==============================================================================
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
      : AudioProcessor (BusesProperties()
@@ -91,28 +64,34 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        ) {
-    splicePtr = apvts.getRawParameterValue("splice");
-    delayPtr = apvts.getRawParameterValue("delay");
-    densityPtr = apvts.getRawParameterValue("density");
-    pitchPtr = apvts.getRawParameterValue("pitch");
-    spreadPtr = apvts.getRawParameterValue("spread");
-    feedbackPtr = apvts.getRawParameterValue("feedback");
-    widthPtr = apvts.getRawParameterValue("width");
-    tonePtr = apvts.getRawParameterValue("tone");
-    reversePtr = apvts.getRawParameterValue("reverse");
-    mixPtr = apvts.getRawParameterValue("mix");
-    pitchOffsetPtr  = apvts.getRawParameterValue("pitchOffset");
-    spliceOffsetPtr = apvts.getRawParameterValue("spliceOffset");
-    delayOffsetPtr  = apvts.getRawParameterValue("delayOffset");
-
-    // logFile = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
-    //             .getChildFile("GranularFxDebug.log");
-    // 
-    // logFile.deleteFile();
-    // logFile.create();
+    for (int param = 0; param < ParameterIDs::numParams; ++param)
+        rawParams[(size_t)param] = apvts.getRawParameterValue(ParameterIDs::get((ParamID)param));
+
+    grainPool.setWorkers(&renderWorkers);
+
+    // Attached once so the audio thread never sees the pointer change, recording is switched by start and stop
+    if constexpr (GrainEvents::enabled) {
+        grainEventLog = std::make_unique<GrainEventLog>();
+        grainPool.setEventLog(grainEventLog.get());
+    }
+
+    // Free-running instances still get their own sequence
+    random.setSeed((uint64_t)juce::Random::getSystemRandom().nextInt64());
+
+    startTimerHz(10);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {
+    stopTimer();
+    renderWorkers.stop();
+}
+
+bool AudioPluginAudioProcessor::startGrainEventLog(const juce::File& file) {
+    return grainEventLog != nullptr && grainEventLog->start(file);
+}
+
+void AudioPluginAudioProcessor::stopGrainEventLog() {
+    if (grainEventLog != nullptr) grainEventLog->stop();
 }
 
 //==============================================================================
@@ -144,8 +123,26 @@ bool AudioPluginAudioProcessor::isMidiEffect() const {
    #endif
 }
 
+// How long output can go on once the input stops: the furthest back a grain can pick the last input up,
+// plus the grain itself, for every pass around the feedback loop until it is below the silence threshold
 double AudioPluginAudioProcessor::getTailLengthSeconds() const {
-    return 0.0;
+    const double splice = getParam(ParamID::splice) / 1000.0;
+    const double delay = (getParam(ParamID::delay) + getParam(ParamID::spread)) / 1000.0;
+    const double pitch = getParam(ParamID::pitch) * std::pow(2.0, getParam(ParamID::pitchOffset) / 1200.0);
+    const double feedback = getParam(ParamID::feedback);
+
+    // Forward grains above unity are pushed back far enough to finish behind the write head
+    double reach = getParam(ParamID::reverse) > 0.5f ? delay + splice * pitch : std::max(delay, splice * (pitch - 1.0));
+    // historyReach belongs to the audio thread, which grows it
+    if (const int size = historySize.load(std::memory_order_relaxed); size > 0)
+        reach = std::min(reach, (double)getHistoryReach(size) / currentSampleRate);
+
+    const double pass = reach + splice;
+
+    if (feedback <= 0.0) return pass;
+    if (feedback >= 1.0) return std::numeric_limits<double>::infinity();
+
+    return pass * (1.0 + std::ceil(std::log((double)silenceThreshold) / std::log(feedback)));
 }
 
 int AudioPluginAudioProcessor::getNumPrograms() {
@@ -172,49 +169,206 @@ void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String
 
 //==============================================================================
 void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock) {
-    juce::ignoreUnused (samplesPerBlock);
-
     currentSampleRate = (int)sampleRate;
 
-    setupSmoother(paramSpliceMs, splicePtr->load());
-    setupSmoother(paramDelayMs, delayPtr->load());
-    setupSmoother(paramDensity, densityPtr->load());
-    setupSmoother(paramPitch, pitchPtr->load());
-    setupSmoother(paramSpread, spreadPtr->load());
+    setupSmoother(paramSpliceMs, getParam(ParamID::splice));
+    setupSmoother(paramDelayMs, getParam(ParamID::delay));
+    setupSmoother(paramDensity, getDensity(getParam(ParamID::density), getParam(ParamID::densityMultiplier)));
+    setupSmoother(paramPitch, getParam(ParamID::pitch));
+    setupSmoother(paramSpread, getParam(ParamID::spread));
 
-    setupSmoother(paramWidth, widthPtr->load());
-    setupSmoother(paramFeedback, feedbackPtr->load());
-    setupSmoother(paramTone, tonePtr->load());
-    setupSmoother(paramMix, mixPtr->load());
+    setupSmoother(paramWidth, getParam(ParamID::width));
+    setupSmoother(paramFeedback, getParam(ParamID::feedback));
+    setupSmoother(paramTone, getParam(ParamID::tone));
+    setupSmoother(paramMix, getParam(ParamID::mix));
 
     paramReverse = true;
 
-    setupSmoother(paramPitchOffset, pitchOffsetPtr->load());
-    setupSmoother(paramSpliceOffset, spliceOffsetPtr->load());
-    setupSmoother(paramDelayOffset, delayOffsetPtr->load());
+    setupSmoother(paramPitchOffset, getParam(ParamID::pitchOffset));
+    setupSmoother(paramSpliceOffset, getParam(ParamID::spliceOffset));
+    setupSmoother(paramDelayOffset, getParam(ParamID::delayOffset));
+
+    paramSeed = (int)getParam(ParamID::seed);
+    if (paramSeed > 0) random.setSeed((uint64_t)paramSeed);
+
+    controlValues = {};
+    staticGains = {};
 
-    samplesUntilNextGrain = 0;
+    nextGrainOnset = 0.0;
     writePos = 0;
 
-    hpfStateL = 0.0f;
-    hpfStateR = 0.0f;
-    lastFeedL = 0.0f;
-    lastFeedR = 0.0f;
+    feedbackChain.reset();
 
-    toneStateL = 0.0f;
-    toneStateR = 0.0f;
+    speakerLayout.setChannelSet(getChannelLayoutOfBus(false, 0));
+    numChannels = speakerLayout.getNumChannels();
 
-    lastOutputL = 0.0f;
-    lastOutputR = 0.0f;
+    wetBuffer.setSize(numChannels, renderSpanSamples);
+    wetBuffer.clear();
+
+    feedbackHistory.setSize(numChannels, renderSpanSamples);
+    feedbackHistory.clear();
+    feedbackPos = 0;
     
-    circularBuffer.respace(bufferSize);
+    {
+        const juce::ScopedLock lock(historyLock);
+
+        // Anything grown for the previous settings is dropped
+        historyGrowth.store(HistoryGrowth::idle, std::memory_order_relaxed);
+        historyWanted.store(0, std::memory_order_relaxed);
+        grownHistory = {};
+        if (grownPeaks != nullptr) retiredPeaks.push_back(std::move(grownPeaks));
+
+        circularBuffer.setFormat(historyFormat);
+        circularBuffer.setLayout(historyLayout);
+        circularBuffer.setNumChannels(numChannels);
+
+        bufferSize = chooseHistorySize(getReachSeconds(getParamSnapshot()) * historyHeadroom * sampleRate, circularBuffer);
+        historyReach = getHistoryReach(bufferSize);
+        historySize.store(bufferSize, std::memory_order_relaxed);
+        circularBuffer.respace(bufferSize);
+
+        // An open editor may be reading the pyramid, so one of another length is replaced rather than respaced
+        if (peakPyramid != nullptr && peakPyramid->getSize() == bufferSize) {
+            peakPyramid->reset();
+        }
+        else {
+            if (peakPyramid != nullptr) retiredPeaks.push_back(std::move(peakPyramid));
+
+            peakPyramid = std::make_unique<PeakPyramid>();
+            peakPyramid->respace(bufferSize);
+            publishedPeaks.store(peakPyramid.get(), std::memory_order_release);
+        }
+    }
+
+    // Before the pool reallocates, which sizes its scratch for the helpers and mustn't pull it out from
+    // under one still finishing a late job
+    renderWorkers.start(renderThreads, (double)samplesPerBlock / sampleRate);
+
+    grainPool.setLayout(speakerLayout);
+    grainPool.setCapacity(grainCapacity);
+    grainPool.reset();
+
+    historySilenceThreshold = silenceThreshold / (2.0f * (float)grainCapacity);
+    silentSamples = 0;
+    idle = false;
+
+    // Faster than any editor refresh, so a frame is always waiting
+    telemetryInterval = juce::jmax(1, (int)(sampleRate / 120.0));
+    samplesSinceTelemetry = 0;
+
+    performanceCounters.prepare(sampleRate, collisionCount);
     
     writePos = 0;
 }
 
+// Furthest behind the write head grains read with these parameter values, spread drawn at its widest. Reverse
+// grains read back at their pitch while the write head moves away from where they started.
+double AudioPluginAudioProcessor::getReachSeconds(const ParameterSnapshot& values) {
+    const double splice = values.get(ParamID::splice) / 1000.0;
+    const double delay = (values.get(ParamID::delay) + values.get(ParamID::spread)) / 1000.0;
+    const double pitch = values.get(ParamID::pitch) * std::pow(2.0, values.get(ParamID::pitchOffset) / 1200.0);
+
+    // Forward grains above unity are pushed back far enough to finish behind the write head
+    if (values.get(ParamID::reverse) > 0.5f) return delay + splice * (1.0 + pitch);
+    return std::max(delay, splice * (pitch - 1.0));
+}
+
+// Shortest power of two that holds reachSamples of history in the buffer's format, within the memory limit
+int AudioPluginAudioProcessor::chooseHistorySize(double reachSamples, const CircularBuffer& buffer) const {
+    const double needed = reachSamples + renderSpanSamples + Interpolation::maxTaps;
+
+    int size = minHistorySamples;
+    while (size < needed && size < maxHistorySamples)
+        size <<= 1;
+
+    while (size > minHistorySamples && buffer.getBytesFor(size) > historyMemoryLimit)
+        size >>= 1;
+
+    return size;
+}
+
+void AudioPluginAudioProcessor::updateHistorySize() {
+    const juce::ScopedLock lock(historyLock);
+
+    // What the audio thread swapped out. The editor only holds a pyramid within a callback of this thread.
+    if (historyGrowth.load(std::memory_order_acquire) == HistoryGrowth::swapped) {
+        grownHistory = {};
+        grownPeaks.reset();
+        historyGrowth.store(HistoryGrowth::idle, std::memory_order_relaxed);
+    }
+
+    retiredPeaks.clear();
+
+    const int size = historySize.load(std::memory_order_relaxed);
+    const int wanted = historyWanted.load(std::memory_order_relaxed);
+
+    if (historyGrowth.load(std::memory_order_relaxed) != HistoryGrowth::idle || size == 0 || wanted <= getHistoryReach(size))
+        return;
+
+    grownHistory.setFormat(circularBuffer.getFormat());
+    grownHistory.setLayout(circularBuffer.getLayout());
+    grownHistory.setNumChannels(circularBuffer.getNumChannels());
+
+    // Nothing to do once the memory limit is reached
+    const int grownSize = chooseHistorySize(wanted * historyHeadroom, grownHistory);
+    if (grownSize <= size) return;
+
+    grownHistory.respace(grownSize);
+    grownPeaks = std::make_unique<PeakPyramid>();
+    grownPeaks->respace(grownSize);
+
+    historyGrowth.store(HistoryGrowth::ready, std::memory_order_release);
+}
+
+// Switches to the longer buffer and pyramid updateHistorySize prepared, at the cost of one copy of the
+// current history, and hands the old ones back to be freed. Grains carry on reading the same samples.
+void AudioPluginAudioProcessor::growHistory() {
+    grownHistory.copyHistory(circularBuffer, writePos);
+    grownPeaks->copyPeaks(*peakPyramid, writePos);
+    grainPool.rebase(writePos, bufferSize, historyReach + Interpolation::maxTaps);
+
+    std::swap(circularBuffer, grownHistory);
+    std::swap(peakPyramid, grownPeaks);
+    publishedPeaks.store(peakPyramid.get(), std::memory_order_release);
+
+    bufferSize = circularBuffer.getMask() + 1;
+    historyReach = getHistoryReach(bufferSize);
+    historySize.store(bufferSize, std::memory_order_relaxed);
+
+    historyGrowth.store(HistoryGrowth::swapped, std::memory_order_release);
+}
+
+// Pulls a grain forward, and shortens it when that isn't enough, until every sample it reads is still in
+// the history. Needed while the parameters reach further than the history has grown yet, or than the
+// memory limit lets it.
+template <bool reverse>
+void AudioPluginAudioProcessor::fitToHistory(GrainPool::HeadParams& head) const {
+    const double reach = (double)historyReach;
+
+    // How much further behind the write head the grain falls for every sample it plays
+    const double drift = reverse ? 1.0 + head.step : 1.0 - head.step;
+
+    double duration = (double)head.durationSamples;
+    double delay = head.delaySamples;
+
+    if (drift > 0.0) {
+        duration = std::min(duration, reach / drift);
+        delay = std::min(delay, reach - duration * drift);
+    }
+    else {
+        delay = std::min(delay, reach);
+
+        // Still finishes behind the write head
+        if (drift < 0.0 && delay < head.delaySamples)
+            duration = std::min(duration, delay / -drift);
+    }
+
+    head.delaySamples = delay;
+    head.durationSamples = std::max(1, (int)duration);
+}
+
 void AudioPluginAudioProcessor::releaseResources() {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    renderWorkers.stop();
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const {
@@ -222,12 +376,18 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Mono, stereo and the common surround layouts up to 7.1.4. Some plugin hosts, such as certain
+    // GarageBand versions, will only load plugins that support stereo bus layouts.
+    const auto output = layouts.getMainOutputChannelSet();
+
+    if (output != juce::AudioChannelSet::mono()
+     && output != juce::AudioChannelSet::stereo()
+     && output != juce::AudioChannelSet::quadraphonic()
+     && output != juce::AudioChannelSet::create5point0()
+     && output != juce::AudioChannelSet::create5point1()
+     && output != juce::AudioChannelSet::create7point0()
+     && output != juce::AudioChannelSet::create7point1()
+     && output != juce::AudioChannelSet::create7point1point4())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -241,166 +401,470 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 }
 
 
+// The scenes replace the parameters while they are set, presetBank only hands back slots already stored
+void AudioPluginAudioProcessor::updateBlockParams() {
+    for (int param = 0; param < ParameterIDs::numParams; ++param)
+        blockParams.values[(size_t)param] = rawParams[(size_t)param]->load(std::memory_order_relaxed);
+
+    const int scenes = morphScenes.load(std::memory_order_relaxed);
+    if (scenes < 0) return;
+
+    const auto* a = presetBank.get(scenes / PresetBank::numSlots);
+    const auto* b = presetBank.get(scenes % PresetBank::numSlots);
+    if (a == nullptr || b == nullptr) return;
+
+    const float morph = juce::jlimit(0.0f, 1.0f, blockParams.get(ParamID::morph));
+    PresetBank::morph(*a, *b, morph, blockParams);
+    blockParams.set(ParamID::morph, morph);
+}
+
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) {
     juce::ignoreUnused (midiMessages);
 
+    const juce::int64 blockStartTicks = juce::Time::getHighResolutionTicks();
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto numSamples = buffer.getNumSamples();
 
-    paramSpliceMs.setTargetValue(splicePtr->load());
-    paramDelayMs.setTargetValue(delayPtr->load());
-    paramDensity.setTargetValue(densityPtr->load());
-    paramPitch.setTargetValue(pitchPtr->load());
-    paramSpread.setTargetValue(spreadPtr->load());
-    paramFeedback.setTargetValue(feedbackPtr->load());
-    paramWidth.setTargetValue(widthPtr->load());
-    paramTone.setTargetValue(tonePtr->load());
-    paramReverse = reversePtr->load() > 0.5f;
-    paramMix.setTargetValue(mixPtr->load());
-
-    paramPitchOffset.setTargetValue(pitchOffsetPtr->load());
-    paramSpliceOffset.setTargetValue(spliceOffsetPtr->load());
-    paramDelayOffset.setTargetValue(delayOffsetPtr->load());
-
-    // Get write ptr for each channel
-    auto* leftChannel = buffer.getWritePointer(0);
-    auto* rightChannel = (totalNumInputChannels>1) ? buffer.getWritePointer(1) : nullptr;
-
-    for (int i = 0; i < numSamples; ++i) {
-        float curMix      = paramMix.getNextValue();
-        float curFeedback = paramFeedback.getNextValue();
-        float curTone     = paramTone.getNextValue();
-        float curDensity  = paramDensity.getNextValue();
-        float curSplice   = paramSpliceMs.getNextValue();
-        float curPitch    = paramPitch.getNextValue();
-        float curDelay    = paramDelayMs.getNextValue();
-        float curSpread   = paramSpread.getNextValue();
-        float curWidth    = paramWidth.getNextValue();
-        
-        float curPitchOff  = paramPitchOffset.getNextValue();
-        float curSpliceOff = paramSpliceOffset.getNextValue();
-        float curDelayOff  = paramDelayOffset.getNextValue();
-
-        // Calculate tone filter coefficients
-        float toneHz = juce::jmap(curTone, 200.0f, 20000.0f);
-        float alpha = 1.0f - std::exp(-2.0f * juce::MathConstants<float>::pi * toneHz / (float)currentSampleRate);
-
-        float inputL = leftChannel[i];
-        float inputR = rightChannel ? rightChannel[i] : inputL;
-        
-        // --- FEEDBACK ---
-        // Add previous output back into buffer with DC blocker, tone filter, and tanh saturation
-        float rawFeedL = inputL + (lastOutputL * curFeedback);
-        float rawFeedR = inputR + (lastOutputR * curFeedback);
+    // A render helper that ran late may still be reading the old history, which is freed once swapped out
+    if (historyGrowth.load(std::memory_order_acquire) == HistoryGrowth::ready && renderWorkers.isIdle()) growHistory();
+
+    updateBlockParams();
+
+    // Grains reaching past the history are shortened until it has grown
+    const int reach = (int)std::ceil(getReachSeconds(blockParams) * currentSampleRate);
+    if (reach > historyReach) historyWanted.store(reach, std::memory_order_relaxed);
+
+    paramSpliceMs.setTargetValue(getBlockParam(ParamID::splice));
+    paramDelayMs.setTargetValue(getBlockParam(ParamID::delay));
+    paramDensity.setTargetValue(getDensity(getBlockParam(ParamID::density), getBlockParam(ParamID::densityMultiplier)));
+    paramPitch.setTargetValue(getBlockParam(ParamID::pitch));
+    paramSpread.setTargetValue(getBlockParam(ParamID::spread));
+    paramFeedback.setTargetValue(getBlockParam(ParamID::feedback));
+    paramWidth.setTargetValue(getBlockParam(ParamID::width));
+    paramTone.setTargetValue(getBlockParam(ParamID::tone));
+    paramReverse = getBlockParam(ParamID::reverse) > 0.5f;
+    paramEnvelope = (int)getBlockParam(ParamID::envelope);
+    paramInterpolation = (InterpolationMode)juce::jlimit(0, (int)InterpolationMode::numModes - 1, (int)getBlockParam(ParamID::interpolation));
+    grainPool.setStealPolicy((GrainPool::StealPolicy)juce::jlimit(0, 1, (int)getBlockParam(ParamID::steal)));
+
+    int seed = (int)getBlockParam(ParamID::seed);
+    if (seed != paramSeed) {
+        paramSeed = seed;
+        if (paramSeed > 0) random.setSeed((uint64_t)paramSeed);
+    }
+    paramMix.setTargetValue(getBlockParam(ParamID::mix));
 
-        hpfStateL = 0.997f * (hpfStateL + rawFeedL - lastFeedL);
-        hpfStateR = 0.997f * (hpfStateR + rawFeedR - lastFeedR);
-        lastFeedL = rawFeedL;
-        lastFeedR = rawFeedR;
+    paramPitchOffset.setTargetValue(getBlockParam(ParamID::pitchOffset));
+    paramSpliceOffset.setTargetValue(getBlockParam(ParamID::spliceOffset));
+    paramDelayOffset.setTargetValue(getBlockParam(ParamID::delayOffset));
 
-        toneStateL += alpha * (hpfStateL - toneStateL);
-        toneStateR += alpha * (hpfStateR - toneStateR);
+    // Get write ptr for each channel, a mono bus only has the left
+    const int numBusChannels = juce::jmin(totalNumInputChannels, buffer.getNumChannels(), numChannels);
 
-        float feedL = std::tanh(toneStateL);
-        float feedR = std::tanh(toneStateR);
+    std::array<float*, SpeakerLayout::maxChannels> channels {};
+    for (int channel = 0; channel < numBusChannels; ++channel)
+        channels[(size_t)channel] = buffer.getWritePointer(channel);
 
-        circularBuffer.write(feedL, feedR, writePos);
+    collectTelemetry = telemetryEnabled.load(std::memory_order_relaxed);
 
-        // --- TRIGGER GRAINS ---
-        if (samplesUntilNextGrain <= 0) {
-            // Effective pitch ratio per channel
-            float pitchL = curPitch * std::pow(2.0f, -curPitchOff / 1200.0f);
-            float pitchR = curPitch * std::pow(2.0f,  curPitchOff / 1200.0f);
-
-            // Effective splice lengths in samples
-            float spliceSamplesL = std::ceil((curSplice / 1000.0f) * currentSampleRate);
-            float spliceSamplesR = std::ceil(spliceSamplesL * (1.0f - (curSpliceOff / 100.0f)));
-
-            // Total read distance per channel
-            float totalReadSamplesL = spliceSamplesL * pitchL;
-            float totalReadSamplesR = spliceSamplesR * pitchR;
-
-            float spreadMs = juce::Random::getSystemRandom().nextFloat() * curSpread;
-
-            float finalBaseDelay = curDelay + spreadMs;
-
-            if (!paramReverse && pitchR > 1.0) {
-                    float extraDelaySamplesL = std::max(0.0f, totalReadSamplesL - spliceSamplesL);
-                    float extraDelaySamplesR = std::max(0.0f, totalReadSamplesR - spliceSamplesR);
-
-                    float safeMsL = (extraDelaySamplesL / currentSampleRate) * 1000.0f;
-                    float safeMsR = (extraDelaySamplesR / currentSampleRate) * 1000.0f;
-                    float minSafeDelayMs = std::max(safeMsL, safeMsR);
-                    
-                    finalBaseDelay = std::max(finalBaseDelay, minSafeDelayMs);
-            } 
-
-            double delaySampL = (finalBaseDelay / 1000.0) * currentSampleRate;
-            double delaySampR = delaySampL * (1.0 - (curDelayOff / 100.0));
-
-            for (auto& g : grainPool) {
-                if (!g.isActive) {
-
-                    // Random pan, can add ping pong and dual later
-                    float randomSide = juce::Random::getSystemRandom().nextFloat() * 2.0f - 1.0f; 
-                    float grainPan = 0.5f + (randomSide * 0.5f * curWidth);
-                    float panRads = grainPan * juce::MathConstants<float>::halfPi;
-                    float gainL = std::cos(panRads);
-                    float gainR = std::sin(panRads);
-
-                    g.trigger(
-                        writePos,
-                        (int)spliceSamplesL, (int)spliceSamplesR,
-                        delaySampL, delaySampR,
-                        (double)pitchL, (double)pitchR,
-                        gainL, gainR,
-                        paramReverse
-                    );
-                    break;
-                }
-            }
+    // Any input wakes the processor for the very block it arrives in
+    if (idle && getPeak(channels.data(), numBusChannels, numSamples) >= historySilenceThreshold)
+        idle = false;
+
+    if (idle) {
+        processIdle(channels.data(), numBusChannels, numSamples);
+        performanceCounters.addIdleBlock();
+    }
+    else {
+        const SpanRenderer renderer = spanRenderers[(size_t)paramReverse][(size_t)collectTelemetry];
+
+        // Helpers are only woken when the cloud is dense enough for the pool to hand them work
+        const bool parallel = renderWorkers.getNumWorkers() > 0 && grainPool.getNumActive() >= GrainPool::parallelMinGrains;
+        if (parallel) renderWorkers.beginBlock();
 
-            samplesUntilNextGrain = static_cast<int>(spliceSamplesL / std::max(1.0f, curDensity));
+        for (int spanStart = 0; spanStart < numSamples; spanStart += renderSpanSamples) {
+            const int spanSamples = std::min(renderSpanSamples, numSamples - spanStart);
+
+            std::array<float*, SpeakerLayout::maxChannels> spanChannels {};
+            for (int channel = 0; channel < numBusChannels; ++channel)
+                spanChannels[(size_t)channel] = channels[(size_t)channel] + spanStart;
+
+            (this->*renderer)(spanChannels.data(), numBusChannels, spanSamples);
         }
-        samplesUntilNextGrain--;
-
-        // --- PROCESS GRAINS ---
-        float grainSumL = 0.0f;
-        float grainSumR = 0.0f;
-        
-        for (auto& g : grainPool) {
-            if (g.isActive) {
-                float outL = 0.0f;
-                float outR = 0.0f;
-                
-                // bool wasActive = g.isActive;
-                g.process(circularBuffer, outL, outR, writePos, bufferSize-1, &rightChannelCollision, &rightChannelCollisionSamples);
-                // if (wasActive && !g.isActive) { logGrainStats(g); }
-
-                grainSumL += outL;
-                grainSumR += outR;
-                
-            }
+
+        if (parallel) renderWorkers.endBlock();
+
+        // With the whole history silent no grain, whatever its settings, can read anything back
+        if (silentSamples >= bufferSize) enterIdle();
+    }
+
+    if (collectTelemetry) {
+        if (rightChannelCollision.exchange(false)) {
+            ++collisionCount;
+            lastCollisionSamples = rightChannelCollisionSamples.load();
+        }
+
+        samplesSinceTelemetry += numSamples;
+
+        if (samplesSinceTelemetry >= telemetryInterval) {
+            samplesSinceTelemetry = 0;
+            publishTelemetry();
+        }
+    }
+
+    performanceCounters.endBlock(blockStartTicks, numSamples, grainPool.getNumActive(), grainPool.getCapacity(), collisionCount);
+}
+
+// Smoothers keep moving so nothing jumps on waking, and the dry signal is all there is to mix
+void AudioPluginAudioProcessor::processIdle(float* const* channels, int numBusChannels, int numSamples) {
+    for (int spanStart = 0; spanStart < numSamples; spanStart += renderSpanSamples) {
+        const int spanSamples = std::min(renderSpanSamples, numSamples - spanStart);
+
+        prepareSpanGains(spanSamples);
+        updateControlValues(spanSamples);
+
+        for (int channel = 0; channel < numBusChannels; ++channel) {
+            float* output = channels[channel] + spanStart;
+
+            if (mixRamping)
+                juce::FloatVectorOperations::multiply(output, spanDryGain.data(), spanSamples);
+            else
+                juce::FloatVectorOperations::multiply(output, staticGains.dryGain, spanSamples);
+        }
+    }
+
+    writePos = (writePos + numSamples) & (bufferSize - 1);
+}
+
+// The history, and with it every grain and the feedback loop, is below the threshold. Waking starts
+// a fresh cloud over the silent history.
+void AudioPluginAudioProcessor::enterIdle() {
+    grainPool.reset();
+    feedbackChain.reset();
+    feedbackHistory.clear();
+    nextGrainOnset = 0.0;
+    idle = true;
+}
+
+float AudioPluginAudioProcessor::getPeak(const float* const* channels, int numChannels, int numSamples) {
+    float peak = 0.0f;
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        const auto range = juce::FloatVectorOperations::findMinAndMax(channels[channel], numSamples);
+        peak = std::max(peak, std::max(-range.getStart(), range.getEnd()));
+    }
+
+    return peak;
+}
+
+void AudioPluginAudioProcessor::publishTelemetry() {
+    auto& frame = telemetry.getWriteBuffer();
+    const int mask = bufferSize - 1;
+
+    frame.writePos = writePos;
+    frame.bufferMask = mask;
+    frame.numActiveGrains = grainPool.getNumActive();
+    frame.numGrains = std::min(frame.numActiveGrains, TelemetryFrame::maxGrains);
+
+    // The outermost heads, left and right for stereo
+    const std::array<int, 2> heads { 0, grainPool.getNumHeads() - 1 };
+
+    for (int slot = 0; slot < frame.numGrains; ++slot) {
+        auto& grain = frame.grains[(size_t)slot];
+
+        for (int channel = 0; channel < 2; ++channel) {
+            const int head = heads[(size_t)channel];
+            const double position = grainPool.getReadPosition(head, slot);
+            const double index = std::floor(position);
+            const int total = grainPool.getTotalSamples(head, slot);
+
+            grain.readPosition[(size_t)channel] = (float)(((int)index & mask) + (position - index));
+            grain.totalSamples[(size_t)channel] = total;
+            grain.progress[(size_t)channel] = total > 0 ? (float)grainPool.getSamplesProcessed(head, slot) / (float)total : 0.0f;
+            grain.pitchStep[(size_t)channel] = grainPool.getPitchStep(head, slot);
+        }
+
+        grain.reverse = grainPool.isSlotReverse(slot);
+    }
+
+    frame.collisionCount = collisionCount;
+    frame.lastCollisionSamples = lastCollisionSamples;
+
+    telemetry.publish();
+}
+
+void AudioPluginAudioProcessor::updateControlValues(int numSamples) {
+    auto& c = controlValues;
+
+    c.splice    = paramSpliceMs.getNextValue(numSamples);
+    c.pitch     = paramPitch.getNextValue(numSamples);
+    c.delay     = paramDelayMs.getNextValue(numSamples);
+    c.spread    = paramSpread.getNextValue(numSamples);
+    c.width     = paramWidth.getNextValue(numSamples);
+
+    c.pitchOff  = paramPitchOffset.getNextValue(numSamples);
+    c.spliceOff = paramSpliceOffset.getNextValue(numSamples);
+    c.delayOff  = paramDelayOffset.getNextValue(numSamples);
+
+    // Derived coefficients are only recomputed when their inputs moved
+    float tone = paramTone.getNextValue(numSamples);
+    if (tone != c.tone) {
+        c.tone = tone;
+
+        c.toneAlpha = FeedbackChain::getToneAlpha(tone, currentSampleRate);
+    }
+
+    if (c.pitch != c.derivedPitch || c.pitchOff != c.derivedPitchOff) {
+        c.derivedPitch = c.pitch;
+        c.derivedPitchOff = c.pitchOff;
+
+        // Effective pitch ratio per head, the offset spread from down on the left to up on the right
+        for (int head = 0; head < speakerLayout.getNumHeads(); ++head) {
+            const float side = 2.0f * speakerLayout.getHead(head).offset - 1.0f;
+            c.headPitch[(size_t)head] = c.pitch * std::pow(2.0f, side * c.pitchOff / 1200.0f);
+        }
+
+        c.derivedSplice = -1.0f;
+    }
+
+    if (c.splice != c.derivedSplice || c.spliceOff != c.derivedSpliceOff) {
+        c.derivedSplice = c.splice;
+        c.derivedSpliceOff = c.spliceOff;
+
+        // Effective splice length in samples, each head shortened by its share of the splice offset
+        c.spliceSamples = std::ceil((c.splice / 1000.0f) * currentSampleRate);
+        c.minSafeDelayMs = 0.0f;
+
+        for (int head = 0; head < speakerLayout.getNumHeads(); ++head) {
+            const float offset = speakerLayout.getHead(head).offset;
+            const float headSplice = std::ceil(c.spliceSamples * (1.0f - offset * (c.spliceOff / 100.0f)));
+            c.headSplice[(size_t)head] = headSplice;
+
+            // Distance the head reads beyond its splice
+            const float extraDelaySamples = std::max(0.0f, headSplice * c.headPitch[(size_t)head] - headSplice);
+            c.minSafeDelayMs = std::max(c.minSafeDelayMs, (extraDelaySamples / currentSampleRate) * 1000.0f);
+        }
+    }
+
+    if (c.delayOff != c.derivedDelayOff) {
+        c.derivedDelayOff = c.delayOff;
+
+        for (int head = 0; head < speakerLayout.getNumHeads(); ++head)
+            c.headDelayScale[(size_t)head] = 1.0f - speakerLayout.getHead(head).offset * (c.delayOff / 100.0f);
+    }
+}
+
+void AudioPluginAudioProcessor::prepareSpanGains(int numSamples) {
+    // Feedback amount and density are read per sample, so static values are just filled in
+    if (!paramFeedback.fillRamp(spanFeedback.data(), numSamples))
+        juce::FloatVectorOperations::fill(spanFeedback.data(), paramFeedback.getCurrentValue(), numSamples);
+
+    densityRamping = paramDensity.fillRamp(spanDensity.data(), numSamples);
+    if (densityRamping) {
+        for (int i = 0; i < numSamples; ++i)
+            spanDensityScale[i] = 1.0f / std::sqrt(std::max(1.0f, spanDensity[i]));
+    }
+    else {
+        juce::FloatVectorOperations::fill(spanDensity.data(), paramDensity.getCurrentValue(), numSamples);
+    }
+
+    // Mix gains, equal power
+    mixRamping = paramMix.fillRamp(spanMix.data(), numSamples);
+    if (mixRamping) {
+        for (int i = 0; i < numSamples; ++i) {
+            spanDryGain[i] = std::cos(spanMix[i] * juce::MathConstants<float>::halfPi);
+            spanWetGain[i] = std::sin(spanMix[i] * juce::MathConstants<float>::halfPi);
+        }
+    }
+
+    // Static gains are cached and only recomputed when their target changes
+    float density = paramDensity.getCurrentValue();
+    if (density != staticGains.density) {
+        staticGains.density = density;
+        staticGains.densityScale = 1.0f / std::sqrt(std::max(1.0f, density));
+    }
+
+    float mix = paramMix.getCurrentValue();
+    if (mix != staticGains.mix) {
+        staticGains.mix = mix;
+        staticGains.dryGain = std::cos(mix * juce::MathConstants<float>::halfPi);
+        staticGains.wetGain = std::sin(mix * juce::MathConstants<float>::halfPi);
+    }
+}
+
+const std::array<std::array<AudioPluginAudioProcessor::SpanRenderer, 2>, 2> AudioPluginAudioProcessor::spanRenderers {{
+    { &AudioPluginAudioProcessor::renderSpan<false, false>, &AudioPluginAudioProcessor::renderSpan<false, true> },
+    { &AudioPluginAudioProcessor::renderSpan<true, false>, &AudioPluginAudioProcessor::renderSpan<true, true> }
+}};
+
+// Collects the grains due in [blockStart, blockEnd) of the span, each onset a splice over the density after
+// the last. A grain belongs to the first sample at or after its exact onset.
+int AudioPluginAudioProcessor::scheduleGrains(int blockStart, int blockEnd) {
+    const bool hasHeight = speakerLayout.hasHeightChannels();
+    int numOnsets = 0;
+
+    while (nextGrainOnset <= blockEnd - 1) {
+        const int offset = std::max(blockStart, (int)std::ceil(nextGrainOnset));
+
+        auto& onset = grainOnsets[(size_t)numOnsets++];
+        onset.offset = offset;
+        onset.lead = (float)std::max(0.0, offset - nextGrainOnset);
+
+        // Random spread, and a random pan with a random height on layouts that have height speakers
+        onset.spreadMs = random.nextBatchedFloat() * controlValues.spread;
+        onset.side = random.nextBatchedFloat() * 2.0f - 1.0f;
+        onset.height = hasHeight ? random.nextBatchedFloat() : 0.0f;
+
+        nextGrainOnset += std::max(1.0, (double)controlValues.spliceSamples / std::max(1.0f, spanDensity[(size_t)offset]));
+    }
+
+    return numOnsets;
+}
+
+template <bool reverse>
+void AudioPluginAudioProcessor::triggerGrains(int numOnsets, int spanWritePos) {
+    const auto& c = controlValues;
+    const int numHeads = speakerLayout.getNumHeads();
+    const double direction = reverse ? -1.0 : 1.0;
+
+    for (int n = 0; n < numOnsets; ++n) {
+        const auto& onset = grainOnsets[(size_t)n];
+
+        float finalBaseDelay = c.delay + onset.spreadMs;
+        if (!reverse) finalBaseDelay = std::max(finalBaseDelay, c.minSafeDelayMs);
+
+        const double delaySamples = (finalBaseDelay / 1000.0) * currentSampleRate;
+
+        // A grain whose onset fell between samples has already moved lead samples along when it starts, its
+        // read head by lead times its step and the write head by lead. The envelope's share of it is ignored.
+        std::array<GrainPool::HeadParams, SpeakerLayout::maxHeads> heads;
+
+        for (int head = 0; head < numHeads; ++head) {
+            const double pitch = (double)c.headPitch[(size_t)head];
+            heads[(size_t)head] = { (int)c.headSplice[(size_t)head],
+                                    delaySamples * c.headDelayScale[(size_t)head] + onset.lead * (1.0 - direction * pitch),
+                                    pitch };
+
+            fitToHistory<reverse>(heads[(size_t)head]);
         }
 
-        // --- MIX & OUTPUT ---
-        float densityScale = 1.0f / std::sqrt(std::max(1.0f, curDensity));
-        float wetL = grainSumL * densityScale;
-        float wetR = grainSumR * densityScale;
-        
-        float dryGain = std::cos(curMix * juce::MathConstants<float>::halfPi);
-        float wetGain = std::sin(curMix * juce::MathConstants<float>::halfPi);
-        
-        leftChannel[i] = (inputL * dryGain) + (wetL * wetGain);
-        if (rightChannel) rightChannel[i] = (inputR * dryGain) + (wetR * wetGain);
+        std::array<float, SpeakerLayout::maxChannels> gains;
+        speakerLayout.getGains(onset.side, onset.height, c.width, gains.data());
+
+        const bool hadFreeSlot = grainPool.trigger(
+            (spanWritePos + onset.offset) & (bufferSize - 1),
+            heads.data(),
+            gains.data(),
+            reverse,
+            paramEnvelope,
+            onset.offset
+        );
+
+        if (!hadFreeSlot) performanceCounters.addStolenGrain();
+    }
+}
+
+template <bool reverse, bool telemetry>
+void AudioPluginAudioProcessor::renderSpan(float* const* channels, int numBusChannels, int numSamples) {
+    const int spanWritePos = writePos;
+
+    std::array<float*, SpeakerLayout::maxChannels> wet {};
+    std::array<float*, SpeakerLayout::maxChannels> feedback {};
+    std::array<float*, SpeakerLayout::maxChannels> history {};
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        wet[(size_t)channel] = wetBuffer.getWritePointer(channel);
+        feedback[(size_t)channel] = feedbackHistory.getWritePointer(channel);
+    }
+
+    prepareSpanGains(numSamples);
+
+    for (int blockStart = 0; blockStart < numSamples; blockStart += controlInterval) {
+        const int blockEnd = std::min(numSamples, blockStart + controlInterval);
+
+        updateControlValues(blockEnd - blockStart);
+        const auto& c = controlValues;
 
         // --- FEEDBACK ---
-        lastOutputL = wetL; 
-        lastOutputR = wetR; 
+        // Add the output from one span ago back into buffer with DC blocker, tone filter, and tanh saturation.
+        // All of it is known before the span starts, so the interval is conditioned as one block.
+        // Channels the bus doesn't carry take the first channel's input.
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* input = channels[channel < numBusChannels ? channel : 0];
+            const float* channelFeedback = feedback[(size_t)channel];
+            float* channelHistory = spanHistory[(size_t)channel].data();
+
+            for (int i = blockStart; i < blockEnd; ++i) {
+                const int feedbackIndex = (feedbackPos + i) & (renderSpanSamples - 1);
+                channelHistory[i] = input[i] + (channelFeedback[feedbackIndex] * spanFeedback[i]);
+            }
+
+            history[(size_t)channel] = channelHistory + blockStart;
+        }
+
+        feedbackChain.process(history.data(), numChannels, blockEnd - blockStart, c.toneAlpha);
+
+        // --- TRIGGER GRAINS ---
+        triggerGrains<reverse>(scheduleGrains(blockStart, blockEnd), spanWritePos);
+    }
+
+    writePos = (spanWritePos + numSamples) & (bufferSize - 1);
+    nextGrainOnset -= numSamples;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        history[(size_t)channel] = spanHistory[(size_t)channel].data();
+
+    // Input and feedback alike, counted as they enter the history
+    if (getPeak(history.data(), numChannels, numSamples) < historySilenceThreshold)
+        silentSamples = std::min(silentSamples + numSamples, bufferSize);
+    else
+        silentSamples = 0;
+
+    circularBuffer.writeSpan(history.data(), spanWritePos, numSamples);
+    peakPyramid->update(circularBuffer, spanWritePos, numSamples);
+
+    // --- PROCESS GRAINS ---
+    // Grain-major: every active grain renders its whole span in one pass over the freshly written buffer
+    for (int channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::clear(wet[(size_t)channel], numSamples);
+
+    grainPool.renderSpan(circularBuffer, wet.data(), numSamples, spanWritePos, bufferSize-1, paramInterpolation,
+                         telemetry ? &rightChannelCollision : nullptr, &rightChannelCollisionSamples);
+
+    // --- MIX & OUTPUT ---
+    for (int channel = 0; channel < numChannels; ++channel) {
+        if (densityRamping)
+            juce::FloatVectorOperations::multiply(wet[(size_t)channel], spanDensityScale.data(), numSamples);
+        else
+            juce::FloatVectorOperations::multiply(wet[(size_t)channel], staticGains.densityScale, numSamples);
+    }
+
+    // --- FEEDBACK ---
+    for (int channel = 0; channel < numChannels; ++channel) {
+        const float* channelWet = wet[(size_t)channel];
+        float* channelFeedback = feedback[(size_t)channel];
 
-        writePos = (writePos + 1) & (bufferSize - 1);
+        for (int i = 0; i < numSamples; ++i)
+            channelFeedback[(feedbackPos + i) & (renderSpanSamples - 1)] = channelWet[i];
     }
+
+    feedbackPos = (feedbackPos + numSamples) & (renderSpanSamples - 1);
+
+    auto mixChannel = [&](float* output, const float* input, const float* wetInput) {
+        if (mixRamping) {
+            for (int i = 0; i < numSamples; ++i)
+                output[i] = (input[i] * spanDryGain[i]) + (wetInput[i] * spanWetGain[i]);
+        }
+        else {
+            juce::FloatVectorOperations::multiply(output, input, staticGains.dryGain, numSamples);
+            juce::FloatVectorOperations::addWithMultiply(output, wetInput, staticGains.wetGain, numSamples);
+        }
+    };
+
+    for (int channel = 0; channel < numBusChannels; ++channel)
+        mixChannel(channels[channel], channels[channel], wet[(size_t)channel]);
 }
 
 //==============================================================================
@@ -413,6 +877,47 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor() {
 }
 
 //==============================================================================
+ParameterSnapshot AudioPluginAudioProcessor::getParamSnapshot() const {
+    ParameterSnapshot snapshot;
+    for (int param = 0; param < ParameterIDs::numParams; ++param)
+        snapshot.values[(size_t)param] = rawParams[(size_t)param]->load();
+    return snapshot;
+}
+
+void AudioPluginAudioProcessor::storePreset(int slot) {
+    presetBank.store(slot, getParamSnapshot());
+}
+
+// Parameters a snapshot doesn't have keep their current values
+bool AudioPluginAudioProcessor::storePreset(int slot, const void* data, size_t size) {
+    auto snapshot = getParamSnapshot();
+    if (snapshot.readBinary(data, size) == 0) return false;
+
+    presetBank.store(slot, snapshot);
+    return true;
+}
+
+void AudioPluginAudioProcessor::setMorphScenes(int a, int b) {
+    const bool valid = juce::isPositiveAndBelow(a, PresetBank::numSlots) && juce::isPositiveAndBelow(b, PresetBank::numSlots);
+    morphScenes.store(valid ? a * PresetBank::numSlots + b : -1);
+}
+
+void AudioPluginAudioProcessor::getBinaryState(juce::MemoryBlock& destData) const {
+    getParamSnapshot().writeBinary(destData);
+}
+
+bool AudioPluginAudioProcessor::setBinaryState(const void* data, size_t size) {
+    auto snapshot = getParamSnapshot();
+    if (snapshot.readBinary(data, size) == 0) return false;
+
+    for (int param = 0; param < ParameterIDs::numParams; ++param) {
+        if (auto* parameter = apvts.getParameter(ParameterIDs::get((ParamID)param)))
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(snapshot.values[(size_t)param]));
+    }
+
+    return true;
+}
+
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData) {
     auto state = apvts.copyState();
     std::unique_ptr<juce::XmlElement> xml (state.createXml());
@@ -420,6 +925,11 @@ void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData
 }
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes) {
+    if (ParameterSnapshot::isBinary(data, (size_t)sizeInBytes)) {
+        setBinaryState(data, (size_t)sizeInBytes);
+        return;
+    }
+
     std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
     if (xmlState != nullptr)
         apvts.replaceState (juce::ValueTree::fromXml (*xmlState));
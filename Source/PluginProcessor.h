@@ -3,9 +3,18 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "Grain.h"
 #include "CircularBuffer.h"
+#include "PeakPyramid.h"
+#include "SmoothedParameter.h"
+#include "FastRandom.h"
+#include "FeedbackChain.h"
+#include "ParameterIDs.h"
+#include "SpeakerLayout.h"
+#include "Telemetry.h"
+#include "PerformanceCounters.h"
+#include "PresetBank.h"
 
 //==============================================================================
-class AudioPluginAudioProcessor final : public juce::AudioProcessor {
+class AudioPluginAudioProcessor final : public juce::AudioProcessor, private juce::Timer {
 public:
     //==============================================================================
     AudioPluginAudioProcessor();
@@ -44,78 +53,310 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
+    // Density multiplier choices, the parameter holds the index
+    static constexpr std::array<float, 3> densityMultipliers { 1.0f, 4.0f, 16.0f };
+
+    static juce::StringArray getDensityMultiplierNames() {
+        return { "x1", "x4", "x16" };
+    }
+
+    // Grains per splice from the density and the multiplier's choice index
+    static float getDensity(float density, float multiplier) {
+        return density * densityMultipliers[(size_t)juce::jlimit(0, (int)densityMultipliers.size() - 1, (int)multiplier)];
+    }
+
     juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
 
     //==============================================================================
     CircularBuffer circularBuffer;
     int writePos = 0;
 
-    static constexpr int maxGrains = 32;
-    std::array<Grain, maxGrains> grainPool;
+    // Summary of the history for the editor, from the message thread. Stays valid until the callback it
+    // was fetched in returns, a re-prepare or a longer history publish a new one.
+    const PeakPyramid* getPeakPyramid() const { return publishedPeaks.load(std::memory_order_acquire); }
 
-    std::atomic<bool> rightChannelCollision { false };
-    std::atomic<float> rightChannelCollisionSamples { 0.0f };
+    GrainPool grainPool;
+
+    // Most grains that can play at once, call before prepareToPlay. Beyond it the steal parameter decides
+    // which grain a new one replaces.
+    void setGrainCapacity(int grains) { grainCapacity = juce::jlimit(1, GrainPool::maxCapacity, grains); }
+    int getGrainCapacity() const { return grainCapacity; }
+
+    // Sample storage of the history buffer, int16 halves its memory and cache footprint at a -96 dB
+    // dithered noise floor. Call before prepareToPlay.
+    void setHistoryFormat(HistoryFormat format) { historyFormat = format; }
+    HistoryFormat getHistoryFormat() const { return historyFormat; }
+
+    // Channel arrangement of the history buffer. Interleaved keeps both channels of a frame in the same cache
+    // line, which pays off for scattered stereo reads. The grain kernels stream each channel and favour planar.
+    // Only applies to stereo buses. Call before prepareToPlay.
+    void setHistoryLayout(HistoryLayout layout) { historyLayout = layout; }
+    HistoryLayout getHistoryLayout() const { return historyLayout; }
+
+    // Most memory one instance's history buffer may take, in bytes, not counting a few guard samples. The buffer
+    // is sized to a little beyond the furthest back the current parameter values read at the sample rate,
+    // rounded up to a power of two, and halved while it is over the limit. Grains that reach past it are
+    // shortened until updateHistorySize has grown it. Call before prepareToPlay.
+    void setHistoryMemoryLimit(size_t bytes) { historyMemoryLimit = bytes; }
+    size_t getHistoryMemoryLimit() const { return historyMemoryLimit; }
+
+    // Samples of history per channel, set on prepareToPlay and grown as the parameters need
+    int getHistorySize() const { return historySize.load(std::memory_order_relaxed); }
+
+    // Allocates a longer history once automation or scenes read further back than the current one, and
+    // frees what the audio thread has swapped out. The audio thread takes the new buffer at its next block.
+    // A timer calls this from the message thread, offline renders without a message loop call it between blocks.
+    void updateHistorySize();
+
+    // Helper threads for rendering very dense grain clouds, 0 keeps everything on the audio thread.
+    // Call before prepareToPlay.
+    void setRenderThreads(int threads) { renderThreads = juce::jlimit(0, GrainRenderWorkers::maxWorkers, threads); }
+    int getRenderThreads() const { return renderThreads; }
+
+    // Samples between updates of control-rate parameters and derived coefficients.
+    // Call before prepareToPlay; clamped to the render span.
+    void setControlInterval(int samples) { controlInterval = juce::jlimit(1, renderSpanSamples, samples); }
+    int getControlInterval() const { return controlInterval; }
+
+    // Snapshots of the write head, grains and collisions for the editor, only published while enabled.
+    // The editor is the one reader and must never touch the audio-side state directly.
+    TripleBuffer<TelemetryFrame> telemetry;
+    void setTelemetryEnabled(bool enabled) { telemetryEnabled.store(enabled); }
+
+    // Block timing, load and grain statistics, safe to query from any thread at any rate.
+    // Collisions are only checked while telemetry is enabled.
+    PerformanceCounters::Snapshot getPerformanceStats() const { return performanceCounters.getSnapshot(); }
+    void resetPerformanceStats() { performanceCounters.requestReset(); }
+
+    // Writes every grain trigger, steal, collision and finish to a CSV file from a background thread until
+    // stopped. Only available in builds configured with GRANULAR_GRAIN_EVENTS, elsewhere start returns false.
+    // Call from the message thread.
+    bool startGrainEventLog(const juce::File& file);
+    void stopGrainEventLog();
+
+    // Scenes for live switching. Slots are stored from the message thread, from the current parameters or
+    // from a binary snapshot, and the audio thread reads them without touching the parameter tree. While
+    // scenes are set their values replace the parameters' own, the morph parameter moving from scene a to
+    // scene b, and the smoothers glide to each block's values. Set a and b to the same slot to switch to it.
+    void storePreset(int slot);
+    bool storePreset(int slot, const void* data, size_t size);
+    void setMorphScenes(int a, int b);
+    void clearMorphScenes() { setMorphScenes(-1, -1); }
+
+    // Compact alternative to the XML state, see ParameterSnapshot. setStateInformation takes either.
+    void getBinaryState(juce::MemoryBlock& destData) const;
+    bool setBinaryState(const void* data, size_t size);
 
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
 
     int currentSampleRate = 44100;
-    int bufferSize = 1 << 18; // 6s at 44.1
-
-    int samplesUntilNextGrain;
-
-    juce::LinearSmoothedValue<float> paramSpliceMs;
-    juce::LinearSmoothedValue<float> paramDelayMs;
-    juce::LinearSmoothedValue<float> paramDensity;
-    juce::LinearSmoothedValue<float> paramPitch;
-    juce::LinearSmoothedValue<float> paramSpread;
-    juce::LinearSmoothedValue<float> paramFeedback;
-    juce::LinearSmoothedValue<float> paramWidth;
-    juce::LinearSmoothedValue<float> paramTone;
+    // Power of two, sized on prepareToPlay and grown at the start of a block
+    int bufferSize = 1 << 18;
+
+    // 2^20 frames of stereo float, about 24 s at 44.1 kHz. Only settings reaching that far back grow a
+    // buffer this long, the defaults take 1 MB. The full parameter ranges reach further still.
+    size_t historyMemoryLimit = 8 << 20;
+
+    // Reach the history is sized for, relative to what the parameters need, so small moves don't grow it
+    static constexpr double historyHeadroom = 1.25;
+
+    // The coarsest peak bucket, and a bound that keeps frame counts well inside int
+    static constexpr int minHistorySamples = 1 << 12;
+    static constexpr int maxHistorySamples = 1 << 24;
+
+    // Furthest behind the write head a grain may start or end its reads. The span written ahead of the
+    // grains and the interpolation taps take up the rest of the buffer.
+    int historyReach = 0;
+
+    static int getHistoryReach(int size) { return size - renderSpanSamples - Interpolation::maxTaps; }
+
+    // History growth. The audio thread reports how far back its parameters read, updateHistorySize
+    // respaces a longer buffer and pyramid on the message thread, and the audio thread copies the history
+    // across and swaps them in on a block no render helper is inside a job. The old pair goes back the
+    // same way to be freed.
+    enum class HistoryGrowth { idle, ready, swapped };
+    std::atomic<HistoryGrowth> historyGrowth { HistoryGrowth::idle };
+    std::atomic<int> historyWanted { 0 }; // Reach in samples, only stored while past historyReach
+    std::atomic<int> historySize { 0 };   // bufferSize for other threads
+    CircularBuffer grownHistory;
+
+    std::unique_ptr<PeakPyramid> peakPyramid;
+    std::unique_ptr<PeakPyramid> grownPeaks;
+    std::atomic<const PeakPyramid*> publishedPeaks { nullptr };
+
+    // Pyramids the editor may still be reading, freed from the message thread
+    std::vector<std::unique_ptr<PeakPyramid>> retiredPeaks;
+
+    // Keeps updateHistorySize and prepareToPlay apart, the audio thread never takes it
+    juce::CriticalSection historyLock;
+
+    void growHistory();
+    void timerCallback() override { updateHistorySize(); }
+
+    // Onset of the next grain in samples from the start of the current span, kept fractional so grain
+    // timing doesn't drift with the rounding of the trigger interval
+    double nextGrainOnset = 0.0;
+
+    SmoothedParameter paramSpliceMs;
+    SmoothedParameter paramDelayMs;
+    SmoothedParameter paramDensity;
+    SmoothedParameter paramPitch;
+    SmoothedParameter paramSpread;
+    SmoothedParameter paramFeedback;
+    SmoothedParameter paramWidth;
+    SmoothedParameter paramTone;
     bool paramReverse = true;
-    juce::LinearSmoothedValue<float> paramMix;
+    int paramEnvelope = WindowTables::hann;
+    int paramSeed = 0;
+    InterpolationMode paramInterpolation = InterpolationMode::linear;
+    int grainCapacity = 512; // Live grains track density, so this covers the top of its range at x16
+    int renderThreads = 0;
+    HistoryFormat historyFormat = HistoryFormat::float32;
+    HistoryLayout historyLayout = HistoryLayout::planar;
+    GrainRenderWorkers renderWorkers;
+    std::unique_ptr<GrainEventLog> grainEventLog; // Only created when GrainEvents::enabled
+
+    FastRandom random;
+    SmoothedParameter paramMix;
+
+    SmoothedParameter paramPitchOffset;
+    SmoothedParameter paramSpliceOffset;
+    SmoothedParameter paramDelayOffset;
+
+    FeedbackChain feedbackChain;
+
+    // Speaker positions and read heads of the main bus, taken on prepareToPlay. Never fewer than two
+    // channels, a mono bus runs as stereo with the right input mirroring the left.
+    SpeakerLayout speakerLayout;
+    int numChannels = 2;
+
+    // Grains are rendered grain-major over spans of at most renderSpanSamples, after the span has been written.
+    // The feedback path therefore sees the wet output from exactly one span ago.
+    static constexpr int renderSpanSamples = GrainPool::maxSpanSamples;
+
+    juce::AudioBuffer<float> wetBuffer;
+
+    // Control-rate values and the coefficients derived from them, refreshed every controlInterval samples
+    struct ControlValues {
+        float splice = 0.0f, pitch = 0.0f, delay = 0.0f, spread = 0.0f, width = 0.0f;
+        float pitchOff = 0.0f, spliceOff = 0.0f, delayOff = 0.0f;
+
+        float tone = -1.0f;
+        float toneAlpha = 0.0f;
+
+        float derivedPitch = -1.0f, derivedPitchOff = -1.0f;
+        std::array<float, SpeakerLayout::maxHeads> headPitch { 1.0f, 1.0f, 1.0f };
+
+        // Shared by every grain triggered in the interval
+        float derivedSplice = -1.0f, derivedSpliceOff = -1.0f, derivedDelayOff = -1.0f;
+        float spliceSamples = 0.0f;
+        float minSafeDelayMs = 0.0f; // Keeps forward grains above unity pitch behind the write head
+        std::array<float, SpeakerLayout::maxHeads> headSplice {};
+        std::array<float, SpeakerLayout::maxHeads> headDelayScale {};
+    };
+
+    ControlValues controlValues;
+    int controlInterval = 32;
+
+    // Gain-like values are interpolated per sample, but only while their parameter is actually moving
+    struct StaticGains {
+        float density = -1.0f, densityScale = 1.0f;
+        float mix = -1.0f, dryGain = 1.0f, wetGain = 0.0f;
+    };
 
-    juce::LinearSmoothedValue<float> paramPitchOffset;
-    juce::LinearSmoothedValue<float> paramSpliceOffset;
-    juce::LinearSmoothedValue<float> paramDelayOffset;
+    StaticGains staticGains;
+    bool densityRamping = false;
+    bool mixRamping = false;
 
-    // DC blocker
-    float hpfStateL;
-    float hpfStateR;
-    float lastFeedL;
-    float lastFeedR;
+    std::array<float, renderSpanSamples> spanFeedback;
+    std::array<float, renderSpanSamples> spanDensity;
+    std::array<float, renderSpanSamples> spanDensityScale;
+    std::array<float, renderSpanSamples> spanMix;
+    std::array<float, renderSpanSamples> spanDryGain;
+    std::array<float, renderSpanSamples> spanWetGain;
 
-    // Tone knob
-    float toneStateL;
-    float toneStateR;
+    // Conditioned feedback for the span, written to the history buffer in one go
+    std::array<std::array<float, renderSpanSamples>, SpeakerLayout::maxChannels> spanHistory;
 
     // Feedback
-    float lastOutputL; 
-    float lastOutputR;
+    juce::AudioBuffer<float> feedbackHistory;
+    int feedbackPos = 0;
 
-    void setupSmoother(juce::LinearSmoothedValue<float>& smoother, float initialValue) {
-        smoother.reset(currentSampleRate, 0.025f);
-        smoother.setCurrentAndTargetValue(initialValue);
+    // Idle. Once everything the grains could read has decayed, blocks only pass the dry signal until
+    // input comes back. Silence is judged on what enters the history, and kept low enough that every
+    // grain of the pool summed, interpolation overshoot and all, still stays under the output threshold.
+    static constexpr float silenceThreshold = 1.0e-5f; // -100 dB
+    float historySilenceThreshold = 0.0f;
+    int silentSamples = 0;
+    bool idle = false;
+
+    void processIdle(float* const* channels, int numBusChannels, int numSamples);
+    void enterIdle();
+    static float getPeak(const float* const* channels, int numChannels, int numSamples);
+
+    // Telemetry
+    std::atomic<bool> telemetryEnabled { false };
+    bool collectTelemetry = false;
+    int telemetryInterval = 512;
+    int samplesSinceTelemetry = 0;
+    uint32_t collisionCount = 0;
+    float lastCollisionSamples = 0.0f;
+
+    // Debug, only checked while telemetry is collected
+    std::atomic<bool> rightChannelCollision { false };
+    std::atomic<float> rightChannelCollisionSamples { 0.0f };
+
+    void publishTelemetry();
+
+    PerformanceCounters performanceCounters;
+    void updateControlValues(int numSamples);
+    void prepareSpanGains(int numSamples);
+
+    // A grain due in the current control interval, with its random draws already taken
+    struct GrainOnset {
+        int offset = 0;     // First span sample the grain plays on
+        float lead = 0.0f;  // How far offset lies past the exact onset, in [0, 1)
+        float spreadMs = 0.0f;
+        float side = 0.0f;
+        float height = 0.0f;
+    };
+
+    // The interval can't hold more onsets than samples
+    std::array<GrainOnset, renderSpanSamples> grainOnsets;
+
+    int scheduleGrains(int blockStart, int blockEnd);
+    template <bool reverse>
+    void triggerGrains(int numOnsets, int spanWritePos);
+
+    // Instantiated for every combination of the per-block mode flags, processBlock picks one per block
+    // so the span loops carry no checks for them
+    template <bool reverse, bool telemetry>
+    void renderSpan(float* const* channels, int numBusChannels, int numSamples);
+
+    using SpanRenderer = void (AudioPluginAudioProcessor::*)(float* const*, int, int);
+    static const std::array<std::array<SpanRenderer, 2>, 2> spanRenderers;
+
+    static double getReachSeconds(const ParameterSnapshot& values);
+    int chooseHistorySize(double reachSamples, const CircularBuffer& buffer) const;
+    template <bool reverse>
+    void fitToHistory(GrainPool::HeadParams& head) const;
+
+    void setupSmoother(SmoothedParameter& smoother, float initialValue) {
+        smoother.reset(currentSampleRate, 0.025f, initialValue);
     }
 
-    float getParam(juce::String paramID) { return apvts.getRawParameterValue(paramID)->load(); }
-
-    std::atomic<float>* splicePtr = nullptr;
-    std::atomic<float>* delayPtr = nullptr;
-    std::atomic<float>* densityPtr = nullptr;
-    std::atomic<float>* pitchPtr = nullptr;
-    std::atomic<float>* spreadPtr = nullptr;
-    std::atomic<float>* feedbackPtr = nullptr;
-    std::atomic<float>* widthPtr = nullptr;
-    std::atomic<float>* tonePtr = nullptr;
-    std::atomic<float>* reversePtr = nullptr;
-    std::atomic<float>* mixPtr = nullptr;
-    std::atomic<float>* pitchOffsetPtr = nullptr;
-    std::atomic<float>* spliceOffsetPtr = nullptr;
-    std::atomic<float>* delayOffsetPtr = nullptr;
-
-    // void logGrainStats(const Grain& g);
-    // juce::File logFile;
-    // juce::CriticalSection logMutex;
+    // Raw parameter values, looked up once and indexed by ParamID
+    std::array<std::atomic<float>*, ParameterIDs::numParams> rawParams {};
+    float getParam(ParamID param) const { return rawParams[(size_t)param]->load(); }
+    ParameterSnapshot getParamSnapshot() const;
+
+    // What processBlock runs on: the parameters, or the scenes' values while they are set
+    PresetBank presetBank;
+    std::atomic<int> morphScenes { -1 }; // a * PresetBank::numSlots + b, -1 for none
+    ParameterSnapshot blockParams;
+    void updateBlockParams();
+    float getBlockParam(ParamID param) const { return blockParams.get(param); }
 };
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "ParameterIDs.h"
+#include "Telemetry.h"
+#include <cstdint>
+#include <cstring>
+
+// Plain (unnormalised) value of every parameter, indexed by ParamID
+struct ParameterSnapshot {
+    std::array<float, ParameterIDs::numParams> values {};
+
+    float get(ParamID param) const { return values[(size_t)param]; }
+    void set(ParamID param, float value) { values[(size_t)param] = value; }
+
+    // Compact binary form: a tag, the version and the parameter count, then one little-endian float per
+    // parameter in ParamID order. Parameters are only ever appended, so older snapshots load with the
+    // newer parameters left as they are.
+    static constexpr uint32_t tag = 0x50584647; // "GFXP"
+    static constexpr uint16_t version = 1;
+    static constexpr size_t headerBytes = 8;
+    static constexpr size_t maxBinaryBytes = headerBytes + ParameterIDs::numParams * sizeof(float);
+
+    void writeBinary(juce::MemoryBlock& dest) const {
+        juce::MemoryOutputStream stream(dest, false);
+        stream.writeInt((int)tag);
+        stream.writeShort((short)version);
+        stream.writeShort((short)ParameterIDs::numParams);
+
+        for (const float value : values)
+            stream.writeFloat(value);
+    }
+
+    static bool isBinary(const void* data, size_t size) {
+        return size >= headerBytes && juce::ByteOrder::littleEndianInt(data) == tag;
+    }
+
+    // Returns the number of values read, 0 when data isn't a snapshot. Values past it are left untouched.
+    int readBinary(const void* data, size_t size) {
+        if (!isBinary(data, size)) return 0;
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        if (juce::ByteOrder::littleEndianShort(bytes + 4) > version) return 0;
+
+        const int count = std::min({ (int)juce::ByteOrder::littleEndianShort(bytes + 6), ParameterIDs::numParams,
+                                     (int)((size - headerBytes) / sizeof(float)) });
+
+        for (int param = 0; param < count; ++param) {
+            const uint32_t bits = juce::ByteOrder::littleEndianInt(bytes + headerBytes + (size_t)param * sizeof(float));
+            std::memcpy(&values[(size_t)param], &bits, sizeof(float));
+        }
+
+        return count;
+    }
+};
+
+// Fixed set of parameter snapshots to switch and morph between while playing. Slots are filled on the
+// message thread and handed to the audio thread through triple buffers, so neither side waits or
+// allocates. Storing into a slot the audio thread is morphing from takes effect on its next block.
+class PresetBank {
+public:
+    static constexpr int numSlots = 8;
+
+    // Message thread
+    void store(int slot, const ParameterSnapshot& snapshot) {
+        if (!isValidSlot(slot)) return;
+
+        auto& buffer = slots[(size_t)slot];
+        buffer.getWriteBuffer() = { snapshot, true };
+        buffer.publish();
+    }
+
+    // Audio thread. Picks up newly stored slots, nullptr for one that was never stored.
+    const ParameterSnapshot* get(int slot) {
+        if (!isValidSlot(slot)) return nullptr;
+
+        auto& buffer = slots[(size_t)slot];
+        buffer.update();
+
+        const auto& stored = buffer.getReadBuffer();
+        return stored.valid ? &stored.snapshot : nullptr;
+    }
+
+    // Continuous parameters move linearly from a to b, the switches, choices and seed flip halfway
+    static void morph(const ParameterSnapshot& a, const ParameterSnapshot& b, float amount, ParameterSnapshot& out) {
+        for (int param = 0; param < ParameterIDs::numParams; ++param) {
+            const float from = a.values[(size_t)param];
+            const float to = b.values[(size_t)param];
+
+            out.values[(size_t)param] = ParameterIDs::isDiscrete((ParamID)param) ? (amount < 0.5f ? from : to)
+                                                                                 : from + (to - from) * amount;
+        }
+    }
+
+private:
+    struct Slot {
+        ParameterSnapshot snapshot;
+        bool valid = false;
+    };
+
+    std::array<TripleBuffer<Slot>, numSlots> slots;
+
+    static bool isValidSlot(int slot) { return slot >= 0 && slot < numSlots; }
+};
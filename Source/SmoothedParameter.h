@@ -0,0 +1,75 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+// Linear parameter ramp that knows when it's static, so callers can skip smoothing entirely.
+// Control-rate values jump ahead a whole control interval at a time, audio-rate (gain-like) values are
+// written out as a ramp into a block buffer, and only while a ramp is actually running.
+class SmoothedParameter {
+public:
+    void reset(double sampleRate, double rampSeconds, float initialValue) {
+        rampSamples = std::max(1, (int)std::floor(sampleRate * rampSeconds));
+        setCurrentAndTargetValue(initialValue);
+    }
+
+    void setCurrentAndTargetValue(float newValue) {
+        current = target = newValue;
+        countdown = 0;
+    }
+
+    void setTargetValue(float newTarget) {
+        if (newTarget == target) return;
+
+        target = newTarget;
+        countdown = rampSamples;
+        step = (target - current) / (float)countdown;
+    }
+
+    bool isSmoothing() const { return countdown > 0; }
+    float getCurrentValue() const { return current; }
+    float getTargetValue() const { return target; }
+
+    // Control rate: advance numSamples and return the value reached
+    float getNextValue(int numSamples) {
+        if (countdown <= 0) return target;
+
+        if (numSamples >= countdown) {
+            setCurrentAndTargetValue(target);
+        }
+        else {
+            current += step * (float)numSamples;
+            countdown -= numSamples;
+        }
+
+        return current;
+    }
+
+    // Audio rate: write the next numSamples values into dest and advance.
+    // Returns false without touching dest when the parameter is static.
+    bool fillRamp(float* dest, int numSamples) {
+        if (countdown <= 0) return false;
+
+        const int rampLength = std::min(numSamples, countdown);
+
+        for (int i = 0; i < rampLength; ++i) {
+            current += step;
+            dest[i] = current;
+        }
+
+        countdown -= rampLength;
+
+        if (countdown == 0) {
+            current = target;
+            std::fill(dest + rampLength - 1, dest + numSamples, target);
+        }
+
+        return true;
+    }
+
+private:
+    float current = 0.0f;
+    float target = 0.0f;
+    float step = 0.0f;
+    int countdown = 0;
+    int rampSamples = 1;
+};
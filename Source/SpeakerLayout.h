@@ -0,0 +1,172 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <array>
+
+// Where the processor's channels sit around the listener, and how a grain is spread over them.
+//
+// Grains read the history through one head per side of the room: left, centre line and right. A head's
+// pitch, splice and delay offsets are blended from the left settings at offset 0 to the right ones at 1,
+// and every speaker on its side renders from it, so read positions and envelopes are worked out once per
+// head however many channels share it. Stereo is two heads of one channel each, the original left/right
+// pair. LFE channels get no grains.
+class SpeakerLayout {
+public:
+    static constexpr int maxChannels = 12; // 7.1.4
+    static constexpr int maxHeads = 3;
+
+    struct Head {
+        float offset = 0.0f;
+        int numChannels = 0;
+        std::array<int, maxChannels> channels {};
+
+        // The channels the head renders
+        const int* begin() const { return channels.data(); }
+        const int* end() const { return channels.data() + numChannels; }
+    };
+
+    SpeakerLayout() { setChannelSet(juce::AudioChannelSet::stereo()); }
+
+    // Mono runs as stereo, the processor always keeps at least two channels of history.
+    // Channels without a known position are spaced evenly around the listener.
+    void setChannelSet(const juce::AudioChannelSet& set) {
+        const bool mono = set.size() < 2;
+        numChannels = mono ? 2 : std::min(set.size(), maxChannels);
+        hasHeight = false;
+
+        bool placed = true;
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const auto type = mono ? (channel == 0 ? juce::AudioChannelSet::left : juce::AudioChannelSet::right)
+                                   : set.getTypeOfChannel(channel);
+            placed = placeSpeaker(speakers[(size_t)channel], type) && placed;
+            hasHeight = hasHeight || speakers[(size_t)channel].z > 0.0f;
+        }
+
+        if (!placed) {
+            hasHeight = false;
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const float azimuth = 360.0f * ((float)channel + 0.5f) / (float)numChannels - 180.0f;
+                const bool lfe = speakers[(size_t)channel].lfe;
+                speakers[(size_t)channel] = fromAngles(azimuth, 0.0f);
+                speakers[(size_t)channel].lfe = lfe;
+            }
+        }
+
+        numHeads = 0;
+        maxHeadChannels = 0;
+
+        for (const float offset : { 0.0f, 0.5f, 1.0f }) {
+            Head& head = heads[(size_t)numHeads];
+            head = { offset, 0, {} };
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const auto& speaker = speakers[(size_t)channel];
+                if (!speaker.lfe && getSideOffset(speaker) == offset)
+                    head.channels[(size_t)head.numChannels++] = channel;
+            }
+
+            if (head.numChannels > 0) {
+                maxHeadChannels = std::max(maxHeadChannels, head.numChannels);
+                ++numHeads;
+            }
+        }
+    }
+
+    int getNumChannels() const { return numChannels; }
+    int getNumHeads() const { return numHeads; }
+    const Head& getHead(int head) const { return heads[(size_t)head]; }
+    int getMaxHeadChannels() const { return maxHeadChannels; }
+    bool isLFE(int channel) const { return speakers[(size_t)channel].lfe; }
+    bool hasHeightChannels() const { return hasHeight; }
+
+    // Constant-power gains for a grain at side in [-1, 1] from left to right and height in [0, 1], scattered
+    // by width. Stereo keeps the sine/cosine pan law. Larger layouts aim a cardioid lobe at the grain's
+    // direction, width 1 reaching all the way round and up to the height speakers.
+    void getGains(float side, float height, float width, float* gains) const {
+        if (numChannels == 2) {
+            const float pan = (0.5f + (side * 0.5f * width)) * juce::MathConstants<float>::halfPi;
+            gains[0] = std::cos(pan);
+            gains[1] = std::sin(pan);
+            return;
+        }
+
+        const float azimuth = side * width * juce::MathConstants<float>::pi;
+        const float elevation = height * width * juce::MathConstants<float>::pi * 0.25f;
+        const Speaker direction { std::sin(azimuth) * std::cos(elevation), std::cos(azimuth) * std::cos(elevation),
+                                  std::sin(elevation), false };
+
+        float power = 0.0f;
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const auto& speaker = speakers[(size_t)channel];
+            float gain = 0.0f;
+
+            if (!speaker.lfe) {
+                const float cardioid = 0.5f + 0.5f * (direction.x * speaker.x + direction.y * speaker.y + direction.z * speaker.z);
+                gain = cardioid * cardioid;
+                gain *= gain;
+            }
+
+            gains[channel] = gain;
+            power += gain * gain;
+        }
+
+        const float normalise = 1.0f / std::sqrt(power);
+        for (int channel = 0; channel < numChannels; ++channel)
+            gains[channel] *= normalise;
+    }
+
+private:
+    // Unit vector towards the speaker, x to the right, y to the front and z up
+    struct Speaker {
+        float x = 0.0f, y = 1.0f, z = 0.0f;
+        bool lfe = false;
+    };
+
+    std::array<Speaker, maxChannels> speakers;
+    std::array<Head, maxHeads> heads;
+    int numChannels = 0;
+    int numHeads = 0;
+    int maxHeadChannels = 0;
+    bool hasHeight = false;
+
+    // Angles in degrees, negative azimuth to the left
+    static Speaker fromAngles(float azimuth, float elevation) {
+        const float a = juce::degreesToRadians(azimuth);
+        const float e = juce::degreesToRadians(elevation);
+        return { std::sin(a) * std::cos(e), std::cos(a) * std::cos(e), std::sin(e), false };
+    }
+
+    // ITU-style positions, false for channel types without one
+    static bool placeSpeaker(Speaker& speaker, juce::AudioChannelSet::ChannelType type) {
+        using Set = juce::AudioChannelSet;
+
+        switch (type) {
+            case Set::left:              speaker = fromAngles(-30.0f, 0.0f);   return true;
+            case Set::right:             speaker = fromAngles(30.0f, 0.0f);    return true;
+            case Set::centre:            speaker = fromAngles(0.0f, 0.0f);     return true;
+            case Set::leftSurround:      speaker = fromAngles(-110.0f, 0.0f);  return true;
+            case Set::rightSurround:     speaker = fromAngles(110.0f, 0.0f);   return true;
+            case Set::centreSurround:    speaker = fromAngles(180.0f, 0.0f);   return true;
+            case Set::leftSurroundSide:  speaker = fromAngles(-90.0f, 0.0f);   return true;
+            case Set::rightSurroundSide: speaker = fromAngles(90.0f, 0.0f);    return true;
+            case Set::leftSurroundRear:  speaker = fromAngles(-150.0f, 0.0f);  return true;
+            case Set::rightSurroundRear: speaker = fromAngles(150.0f, 0.0f);   return true;
+            case Set::topFrontLeft:      speaker = fromAngles(-45.0f, 45.0f);  return true;
+            case Set::topFrontRight:     speaker = fromAngles(45.0f, 45.0f);   return true;
+            case Set::topRearLeft:       speaker = fromAngles(-135.0f, 45.0f); return true;
+            case Set::topRearRight:      speaker = fromAngles(135.0f, 45.0f);  return true;
+            case Set::LFE:
+            case Set::LFE2:              speaker = {}; speaker.lfe = true;     return true;
+            default:                     speaker = {};                         return false;
+        }
+    }
+
+    // Which side's settings the speaker reads with: 0 left, 0.5 centre line, 1 right
+    static float getSideOffset(const Speaker& speaker) {
+        constexpr float centreLine = 0.01f;
+        if (speaker.x < -centreLine) return 0.0f;
+        if (speaker.x > centreLine) return 1.0f;
+        return 0.5f;
+    }
+};
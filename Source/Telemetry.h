@@ -0,0 +1,64 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer triple buffer. The writer fills a private back buffer and the reader
+// holds a private front buffer, the two trade through a shared middle slot with one atomic exchange each.
+// Neither side ever waits or allocates, and the reader always gets the newest complete frame.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side
+    T& getWriteBuffer() { return buffers[(size_t)backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Reader side. Swaps in the newest frame, false if nothing was published since the last call.
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & freshBit) == 0) return false;
+
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const { return buffers[(size_t)frontIndex]; }
+
+private:
+    static constexpr int freshBit = 4;
+    static constexpr int indexMask = 3;
+
+    std::array<T, 3> buffers {};
+    std::atomic<int> middle { 1 };
+    int backIndex = 0;
+    int frontIndex = 2;
+};
+
+// What the editor needs to draw one grain, per channel where the channels differ
+struct GrainSnapshot {
+    std::array<float, 2> readPosition {}; // Wrapped into the history buffer
+    std::array<float, 2> progress {};     // Envelope position in [0, 1]
+    std::array<int32_t, 2> totalSamples {};
+    std::array<float, 2> pitchStep {};
+    bool reverse = false;
+};
+
+// Published by the audio thread at most every few milliseconds while an editor is open
+struct TelemetryFrame {
+    // Grains past this are still counted but not drawn
+    static constexpr int maxGrains = 512;
+
+    int writePos = 0;
+    int bufferMask = 0;
+
+    int numGrains = 0;
+    int numActiveGrains = 0;
+    std::array<GrainSnapshot, maxGrains> grains;
+
+    // Counts every collision since the processor started, so none are missed between frames
+    uint32_t collisionCount = 0;
+    float lastCollisionSamples = 0.0f;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+// Precomputed grain envelopes, one table per shape laid out back to back so a kernel can address every
+// shape from a single base pointer. Each table holds tableSize + 1 points over phase [0, 1], the extra
+// point being the guard for interpolation at the very end of a grain. One more trailing zero keeps a
+// phase rounded up to exactly 1 inside the allocation.
+//
+// After the shapes comes the release table, a falling half cosine that fades out stolen grains. It can't
+// be picked as an envelope.
+class WindowTables {
+public:
+    enum Shape {
+        hann = 0,
+        tukey,
+        gaussian,
+        trapezoid,
+        exponentialDecay,
+        numShapes
+    };
+
+    static constexpr int tableSize = 1024;
+    static constexpr int tableStride = tableSize + 1;
+    static constexpr int releaseOffset = numShapes * tableStride;
+
+    static juce::StringArray getShapeNames() {
+        return { "Hann", "Tukey", "Gaussian", "Trapezoid", "Exp Decay" };
+    }
+
+    // Built on first use, which the processor makes sure happens on the message thread
+    static const WindowTables& getInstance() {
+        static const WindowTables instance;
+        return instance;
+    }
+
+    const float* getData() const { return tables.data(); }
+
+    static int getOffset(int shape) {
+        return juce::jlimit(0, (int)numShapes - 1, shape) * tableStride;
+    }
+
+    // Interpolated lookup, phase in [0, 1]
+    float lookup(int shape, float phase) const {
+        float x = phase * (float)tableSize;
+        int i = juce::jlimit(0, tableSize - 1, (int)x);
+        float frac = x - (float)i;
+
+        const float* table = tables.data() + getOffset(shape);
+        return table[i] + frac * (table[i + 1] - table[i]);
+    }
+
+private:
+    std::vector<float> tables;
+
+    WindowTables() : tables((size_t)((numShapes + 1) * tableStride + 1), 0.0f) {
+        for (int shape = 0; shape < numShapes; ++shape) {
+            float* table = tables.data() + getOffset(shape);
+
+            for (int i = 0; i <= tableSize; ++i) {
+                table[i] = evaluate(shape, (double)i / (double)tableSize);
+            }
+        }
+
+        float* release = tables.data() + releaseOffset;
+
+        for (int i = 0; i <= tableSize; ++i) {
+            release[i] = (float)(0.5 * (1.0 + std::cos(juce::MathConstants<double>::pi * (double)i / (double)tableSize)));
+        }
+    }
+
+    static float evaluate(int shape, double x) {
+        constexpr double pi = juce::MathConstants<double>::pi;
+
+        switch (shape) {
+            case tukey: {
+                // Cosine tapers over the outer quarters, flat in between
+                constexpr double taper = 0.25;
+                if (x < taper) return (float)(0.5 * (1.0 - std::cos(pi * x / taper)));
+                if (x > 1.0 - taper) return (float)(0.5 * (1.0 - std::cos(pi * (1.0 - x) / taper)));
+                return 1.0f;
+            }
+
+            case gaussian: {
+                // Shifted and rescaled so the edges land exactly on zero
+                constexpr double sigma = 0.15;
+                auto g = [&](double v) { return std::exp(-0.5 * std::pow((v - 0.5) / sigma, 2.0)); };
+                const double edge = g(0.0);
+                return (float)std::max(0.0, (g(x) - edge) / (1.0 - edge));
+            }
+
+            case trapezoid: {
+                constexpr double ramp = 0.25;
+                return (float)std::min({ 1.0, x / ramp, (1.0 - x) / ramp });
+            }
+
+            case exponentialDecay: {
+                // Short raised cosine attack to avoid a click, then an exponential decay that ends at zero
+                constexpr double attack = 0.02;
+                constexpr double rate = 5.0;
+                if (x < attack) return (float)(0.5 * (1.0 - std::cos(pi * x / attack)));
+
+                const double end = std::exp(-rate);
+                const double decay = std::exp(-rate * (x - attack) / (1.0 - attack));
+                return (float)std::max(0.0, (decay - end) / (1.0 - end));
+            }
+
+            case hann:
+            default:
+                return (float)(0.5 * (1.0 - std::cos(2.0 * pi * x)));
+        }
+    }
+};
@@ -0,0 +1,242 @@
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "../Source/PluginProcessor.h"
+
+// Headless render of a WAV through the processor, as fast as it will go.
+//
+//   GranularFxOfflineRender --input in.wav --output out.wav [--state preset.xml] [--block 512]
+//                           [--tail 2.0] [--grains 32] [--threads 0] [--compact] [--interleaved] [--layout stereo]
+//                           [--memory 8] [--events grains.csv] [--set name=value ...] [--save-state out.xml]
+//                           [--morph-to scene.bin]
+//
+// --state takes a state blob saved from a host by getStateInformation, plain XML as --save-state writes
+// it, or a binary snapshot, and --save-state writes a binary snapshot when the file name ends in .bin. --set takes plain (unnormalised)
+// parameter values and is applied on top of it. --layout picks the bus, one of stereo, quad, 5.0, 5.1,
+// 7.0, 7.1 or 7.1.4, and the output file has that many channels. --morph-to morphs from the parameters
+// to a second state, XML or binary, over the length of the input. --events logs every grain to a CSV file
+// and needs a build configured with GRANULAR_GRAIN_EVENTS. Prints the render speed once done.
+
+namespace {
+    void printUsage() {
+        std::cout << "Usage: GranularFxOfflineRender --input <file.wav> --output <file.wav>" << std::endl
+                  << "         [--state <preset.xml>] [--block <samples>] [--tail <seconds>]" << std::endl
+                  << "         [--grains <capacity>] [--threads <helpers>] [--compact] [--interleaved]" << std::endl
+                  << "         [--layout stereo|quad|5.0|5.1|7.0|7.1|7.1.4] [--memory <MB>]" << std::endl
+                  << "         [--events <grains.csv>] [--morph-to <scene>]" << std::endl
+                  << "         [--set <parameterID>=<value> ...] [--save-state <preset.xml>]" << std::endl
+                  << std::endl
+                  << "Parameters:" << std::endl;
+
+        AudioPluginAudioProcessor processor;
+
+        for (auto* param : processor.getParameters()) {
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(param)) {
+                auto range = ranged->getNormalisableRange();
+                std::cout << "  " << ranged->getParameterID() << " (" << range.start << " - " << range.end
+                          << ", default " << range.convertFrom0to1(ranged->getDefaultValue()) << ")" << std::endl;
+            }
+        }
+    }
+
+    bool loadState(AudioPluginAudioProcessor& processor, const juce::File& file) {
+        juce::MemoryBlock data;
+        if (!file.loadFileAsData(data)) return false;
+
+        if (ParameterSnapshot::isBinary(data.getData(), data.getSize()))
+            return processor.setBinaryState(data.getData(), data.getSize());
+
+        // What getStateInformation writes is XML wrapped by copyXmlToBinary, plain XML is the fallback
+        auto xml = juce::AudioProcessor::getXmlFromBinary(data.getData(), (int)data.getSize());
+        if (xml == nullptr) xml = juce::XmlDocument::parse(data.toString());
+        if (xml == nullptr || !xml->hasTagName(processor.apvts.state.getType())) return false;
+
+        processor.apvts.replaceState(juce::ValueTree::fromXml(*xml));
+        return true;
+    }
+
+    bool setParameter(AudioPluginAudioProcessor& processor, const juce::String& assignment) {
+        auto id = assignment.upToFirstOccurrenceOf("=", false, false).trim();
+        auto value = assignment.fromFirstOccurrenceOf("=", false, false).trim();
+
+        auto* param = processor.apvts.getParameter(id);
+        if (param == nullptr || value.isEmpty()) return false;
+
+        // Bools and choices also accept their text, e.g. reverse=off or envelope=Tukey
+        float plain = value.containsOnly("0123456789.-") ? value.getFloatValue()
+                                                          : param->convertFrom0to1(param->getValueForText(value));
+        param->setValueNotifyingHost(param->convertTo0to1(plain));
+        return true;
+    }
+
+    // Disabled for names it doesn't know
+    juce::AudioChannelSet getChannelSet(const juce::String& name) {
+        if (name == "stereo") return juce::AudioChannelSet::stereo();
+        if (name == "quad") return juce::AudioChannelSet::quadraphonic();
+        if (name == "5.0") return juce::AudioChannelSet::create5point0();
+        if (name == "5.1") return juce::AudioChannelSet::create5point1();
+        if (name == "7.0") return juce::AudioChannelSet::create7point0();
+        if (name == "7.1") return juce::AudioChannelSet::create7point1();
+        if (name == "7.1.4") return juce::AudioChannelSet::create7point1point4();
+        return juce::AudioChannelSet::disabled();
+    }
+
+    int fail(const juce::String& message) {
+        std::cerr << message << std::endl;
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h") || !args.containsOption("--input") || !args.containsOption("--output")) {
+        printUsage();
+        return args.containsOption("--help|-h") ? 0 : 1;
+    }
+
+    auto inputFile = args.getExistingFileForOption("--input");
+    auto outputFile = args.getFileForOption("--output");
+    const int blockSize = juce::jmax(1, args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512);
+    const double tailSeconds = juce::jmax(0.0, args.getValueForOption("--tail").getDoubleValue());
+
+    const auto layoutName = args.containsOption("--layout") ? args.getValueForOption("--layout") : juce::String("stereo");
+    const auto channelSet = getChannelSet(layoutName);
+    if (channelSet.isDisabled()) return fail("Unknown layout: " + layoutName);
+    const int numChannels = channelSet.size();
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(inputFile));
+    if (reader == nullptr) return fail("Couldn't read " + inputFile.getFullPathName());
+
+    const double sampleRate = reader->sampleRate;
+    const int inputSamples = (int)reader->lengthInSamples;
+    const int totalSamples = inputSamples + (int)std::ceil(tailSeconds * sampleRate);
+
+    // Source channels fill the bus in order and anything past it is dropped. Mono sources are duplicated
+    // to the front left and right, which lead every supported layout.
+    juce::AudioBuffer<float> audio(numChannels, totalSamples);
+    audio.clear();
+    reader->read(audio.getArrayOfWritePointers(), juce::jmin(numChannels, (int)reader->numChannels), 0, inputSamples);
+    if (reader->numChannels == 1) audio.copyFrom(1, 0, audio, 0, 0, inputSamples);
+
+    AudioPluginAudioProcessor processor;
+
+    if (args.containsOption("--state")) {
+        auto stateFile = args.getExistingFileForOption("--state");
+        if (!loadState(processor, stateFile)) return fail("Couldn't load state from " + stateFile.getFullPathName());
+    }
+
+    for (int i = 0; i < args.size(); ++i) {
+        if (args[i] == "--set" && i + 1 < args.size()) {
+            auto assignment = args[++i].text;
+            if (!setParameter(processor, assignment)) return fail("Unknown parameter or bad value: " + assignment);
+        }
+    }
+
+    if (args.containsOption("--save-state")) {
+        auto stateFile = args.getFileForOption("--save-state");
+
+        if (stateFile.hasFileExtension("bin")) {
+            juce::MemoryBlock data;
+            processor.getBinaryState(data);
+            stateFile.replaceWithData(data.getData(), data.getSize());
+        }
+        else if (auto xml = processor.apvts.copyState().createXml()) {
+            xml->writeTo(stateFile);
+        }
+    }
+
+    // The parameters as set so far are scene 0, the other state scene 1
+    const bool morphing = args.containsOption("--morph-to");
+    if (morphing) {
+        processor.storePreset(0);
+
+        AudioPluginAudioProcessor target;
+        auto sceneFile = args.getExistingFileForOption("--morph-to");
+        if (!loadState(target, sceneFile)) return fail("Couldn't load state from " + sceneFile.getFullPathName());
+
+        juce::MemoryBlock scene;
+        target.getBinaryState(scene);
+        processor.storePreset(1, scene.getData(), scene.getSize());
+        processor.setMorphScenes(0, 1);
+    }
+
+    if (args.containsOption("--grains"))
+        processor.setGrainCapacity(args.getValueForOption("--grains").getIntValue());
+
+    if (args.containsOption("--threads"))
+        processor.setRenderThreads(args.getValueForOption("--threads").getIntValue());
+
+    // Int16 history storage
+    if (args.containsOption("--compact"))
+        processor.setHistoryFormat(HistoryFormat::int16);
+
+    // Interleaved history frames
+    if (args.containsOption("--interleaved"))
+        processor.setHistoryLayout(HistoryLayout::interleaved);
+
+    // History memory limit in megabytes
+    if (args.containsOption("--memory"))
+        processor.setHistoryMemoryLimit((size_t)(juce::jmax(0.0, args.getValueForOption("--memory").getDoubleValue()) * (1 << 20)));
+
+    // Parameters are in place before prepareToPlay so the smoothers start settled on them
+    juce::AudioProcessor::BusesLayout buses;
+    buses.inputBuses.add(channelSet);
+    buses.outputBuses.add(channelSet);
+    if (!processor.setBusesLayout(buses)) return fail("The processor doesn't support the " + layoutName + " layout");
+
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    if (args.containsOption("--events") && !processor.startGrainEventLog(args.getFileForOption("--events")))
+        return fail("Grain events need a build with GRANULAR_GRAIN_EVENTS, and a writable file");
+
+    juce::MidiBuffer midi;
+    auto* morphParam = processor.apvts.getParameter(ParameterIDs::get(ParamID::morph));
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+
+    for (int pos = 0; pos < totalSamples; pos += blockSize) {
+        const int numSamples = juce::jmin(blockSize, totalSamples - pos);
+        juce::AudioBuffer<float> block(audio.getArrayOfWritePointers(), numChannels, pos, numSamples);
+
+        if (morphing) morphParam->setValueNotifyingHost(juce::jmin(1.0f, (float)pos / (float)juce::jmax(1, inputSamples)));
+
+        processor.processBlock(block, midi);
+
+        // No message loop runs here, so the history grows for parameters and scenes that need it in step
+        processor.updateHistorySize();
+    }
+
+    const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    const auto stats = processor.getPerformanceStats();
+    processor.stopGrainEventLog();
+    processor.releaseResources();
+
+    outputFile.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> stream(outputFile.createOutputStream());
+    if (stream == nullptr) return fail("Couldn't write " + outputFile.getFullPathName());
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), sampleRate, (unsigned int)numChannels, 24, {}, 0));
+    if (writer == nullptr) return fail("Couldn't create a WAV writer for " + outputFile.getFullPathName());
+
+    stream.release();
+    writer->writeFromAudioSampleBuffer(audio, 0, totalSamples);
+
+    const double audioSeconds = totalSamples / sampleRate;
+    std::cout << "Rendered " << juce::String(audioSeconds, 2) << " s of audio in " << juce::String(seconds * 1000.0, 1)
+              << " ms at block size " << blockSize << ", " << layoutName << std::endl
+              << "  " << juce::String(audioSeconds / seconds, 1) << "x realtime, "
+              << juce::String(seconds * 1.0e9 / totalSamples, 1) << " ns/sample" << std::endl;
+    std::cout << "  block " << juce::String(stats.minBlockSeconds * 1.0e6, 1) << " / " << juce::String(stats.meanBlockSeconds * 1.0e6, 1)
+              << " / " << juce::String(stats.maxBlockSeconds * 1.0e6, 1) << " us (min / mean / max), peak load "
+              << juce::String(stats.peakLoad * 100.0, 1) << "%, " << stats.peakActiveGrains << " peak grains, "
+              << (juce::int64)stats.grainsStolen << " stolen, " << (juce::int64)stats.idleBlocks << " of "
+              << (juce::int64)stats.blocks << " blocks idle" << std::endl;
+    std::cout << "  history " << processor.getHistorySize() << " samples, "
+              << juce::String(processor.getHistorySize() / sampleRate, 1) << " s" << std::endl;
+
+    return 0;
+}
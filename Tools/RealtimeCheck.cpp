@@ -0,0 +1,397 @@
+#include "../Source/PluginProcessor.h"
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <time.h>
+ #include <unistd.h>
+#endif
+
+// Drives the processor through prepareToPlay and many processBlock calls and fails if any of them
+// allocates, frees, takes a lock or makes a blocking system call on the audio thread.
+//
+//   GranularFxRealtimeCheck [--blocks 20000] [--max-block 1024] [--seed 1] [--threads 2] [--traces 5]
+//
+// Blocks vary in size, the input moves between signal and silence so idling and waking are covered, and a
+// second thread automates random parameters, stores scenes, morphs between them, toggles telemetry and grows
+// the history the whole time, the way a host, an open editor and the processor's own timer would. Only the
+// audio thread is checked.
+//
+// operator new and delete are replaced everywhere. On Linux malloc and friends, pthread mutexes, condition
+// variables and a few blocking calls are interposed as well. Each violation prints a stack trace, up to
+// --traces of them, and the exit code is the pass or fail.
+//
+// Render helpers run by default, so dense blocks go through the parallel path and the handoff to the helpers
+// is checked along with the rest. A run whose cloud never gets dense enough for them fails too.
+
+namespace RealtimeCheck {
+    // Set on the audio thread for the length of each processBlock
+    thread_local bool armed = false;
+
+    std::atomic<int> violations { 0 };
+    int maxTraces = 5;
+
+    void report(const char* what) {
+        armed = false; // Reporting allocates and writes
+
+        const int count = ++violations;
+        if (count <= maxTraces) {
+            std::fprintf(stderr, "%s on the audio thread\n%s\n", what, juce::SystemStats::getStackBacktrace().toRawUTF8());
+        }
+
+        armed = true;
+    }
+
+    inline void check(const char* what) {
+        if (armed) report(what);
+    }
+
+    struct ScopedArm {
+        ScopedArm() { armed = true; }
+        ~ScopedArm() { armed = false; }
+    };
+}
+
+//==============================================================================
+// The allocator underneath both kinds of hook, so one allocation is reported once. glibc exports its own
+// under __libc_ names.
+#if defined(__GLIBC__)
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+
+namespace RealtimeCheck {
+    void* allocate(size_t size) { return __libc_malloc(size); }
+    void* allocateAligned(size_t alignment, size_t size) { return __libc_memalign(alignment, size); }
+    void release(void* p) { __libc_free(p); }
+}
+#else
+namespace RealtimeCheck {
+    void* allocate(size_t size) { return std::malloc(size); }
+    void* allocateAligned(size_t alignment, size_t size) { return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment); }
+    void release(void* p) { std::free(p); }
+}
+#endif
+
+//==============================================================================
+// operator new and delete, replaceable on every platform
+void* operator new(std::size_t size) {
+    RealtimeCheck::check("operator new");
+    if (void* p = RealtimeCheck::allocate(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    RealtimeCheck::check("operator new[]");
+    if (void* p = RealtimeCheck::allocate(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    RealtimeCheck::check("operator new");
+    return RealtimeCheck::allocate(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    RealtimeCheck::check("operator new[]");
+    return RealtimeCheck::allocate(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) RealtimeCheck::check("operator delete");
+    RealtimeCheck::release(p);
+}
+
+void operator delete[](void* p) noexcept {
+    if (p != nullptr) RealtimeCheck::check("operator delete[]");
+    RealtimeCheck::release(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete[](p); }
+
+#if __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    RealtimeCheck::check("operator new");
+    if (void* p = RealtimeCheck::allocateAligned((size_t)alignment, size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    if (p != nullptr) RealtimeCheck::check("operator delete");
+    RealtimeCheck::release(p);
+}
+
+void operator delete[](void* p, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete[](void* p, std::size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+#endif
+
+//==============================================================================
+// Interposed C library calls
+#if defined(__GLIBC__)
+extern "C" {
+    void* malloc(size_t size) {
+        RealtimeCheck::check("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        RealtimeCheck::check("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size) {
+        RealtimeCheck::check("realloc");
+        return __libc_realloc(p, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        RealtimeCheck::check("memalign");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        RealtimeCheck::check("aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** p, size_t alignment, size_t size) {
+        RealtimeCheck::check("posix_memalign");
+        *p = __libc_memalign(alignment, size);
+        return *p != nullptr ? 0 : ENOMEM;
+    }
+
+    void free(void* p) {
+        if (p != nullptr) RealtimeCheck::check("free");
+        __libc_free(p);
+    }
+}
+#endif
+
+#if defined(__linux__)
+// The next definition of each call is looked up on first use, and all of them again from main before
+// anything is armed, so the audio thread never ends up in dlsym
+namespace RealtimeCheck {
+    template <typename Fn>
+    Fn original(Fn& cached, const char* name) {
+        if (cached == nullptr) cached = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+        return cached;
+    }
+
+    decltype(&pthread_mutex_lock) mutexLock = nullptr;
+    decltype(&pthread_rwlock_rdlock) readLock = nullptr;
+    decltype(&pthread_rwlock_wrlock) writeLock = nullptr;
+    decltype(&pthread_cond_wait) condWait = nullptr;
+    decltype(&pthread_cond_timedwait) condTimedWait = nullptr;
+    decltype(&::nanosleep) sleep = nullptr;
+    decltype(&::usleep) microSleep = nullptr;
+    decltype(&::write) writeFile = nullptr;
+    decltype(&::read) readFile = nullptr;
+
+    void resolveOriginals() {
+        original(mutexLock, "pthread_mutex_lock");
+        original(readLock, "pthread_rwlock_rdlock");
+        original(writeLock, "pthread_rwlock_wrlock");
+        original(condWait, "pthread_cond_wait");
+        original(condTimedWait, "pthread_cond_timedwait");
+        original(sleep, "nanosleep");
+        original(microSleep, "usleep");
+        original(writeFile, "write");
+        original(readFile, "read");
+    }
+}
+
+extern "C" {
+    int pthread_mutex_lock(pthread_mutex_t* mutex) {
+        RealtimeCheck::check("pthread_mutex_lock");
+        return RealtimeCheck::original(RealtimeCheck::mutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock) {
+        RealtimeCheck::check("pthread_rwlock_rdlock");
+        return RealtimeCheck::original(RealtimeCheck::readLock, "pthread_rwlock_rdlock")(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock) {
+        RealtimeCheck::check("pthread_rwlock_wrlock");
+        return RealtimeCheck::original(RealtimeCheck::writeLock, "pthread_rwlock_wrlock")(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex) {
+        RealtimeCheck::check("pthread_cond_wait");
+        return RealtimeCheck::original(RealtimeCheck::condWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* time) {
+        RealtimeCheck::check("pthread_cond_timedwait");
+        return RealtimeCheck::original(RealtimeCheck::condTimedWait, "pthread_cond_timedwait")(condition, mutex, time);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining) {
+        RealtimeCheck::check("nanosleep");
+        return RealtimeCheck::original(RealtimeCheck::sleep, "nanosleep")(duration, remaining);
+    }
+
+    int usleep(useconds_t microseconds) {
+        RealtimeCheck::check("usleep");
+        return RealtimeCheck::original(RealtimeCheck::microSleep, "usleep")(microseconds);
+    }
+
+    ssize_t write(int fd, const void* data, size_t size) {
+        RealtimeCheck::check("write");
+        return RealtimeCheck::original(RealtimeCheck::writeFile, "write")(fd, data, size);
+    }
+
+    ssize_t read(int fd, void* data, size_t size) {
+        RealtimeCheck::check("read");
+        return RealtimeCheck::original(RealtimeCheck::readFile, "read")(fd, data, size);
+    }
+}
+#endif
+
+//==============================================================================
+namespace {
+    void printUsage() {
+        std::cout << "Usage: GranularFxRealtimeCheck [--blocks <count>] [--max-block <samples>] [--seed <n>]" << std::endl
+                  << "         [--threads <helpers>] [--traces <count>]" << std::endl;
+    }
+
+    // Plays host and editor against the audio thread: parameter automation, scene changes and the
+    // telemetry switch, at a few hundred changes a second, and history growth in place of the timer
+    class Automation : public juce::Thread {
+    public:
+        // While set, density and its multiplier are held at the top of their ranges
+        std::atomic<bool> dense { false };
+
+        Automation(AudioPluginAudioProcessor& p, int seed) : juce::Thread("Automation"), processor(p), random(seed) {
+            for (int param = 0; param < ParameterIDs::numParams; ++param)
+                parameters.push_back(processor.apvts.getParameter(ParameterIDs::get((ParamID)param)));
+        }
+
+        ~Automation() override { stopThread(1000); }
+
+        void run() override {
+            while (!threadShouldExit()) {
+                const int action = random.nextInt(100);
+
+                if (action < 85) {
+                    auto* param = parameters[(size_t)random.nextInt((int)parameters.size())];
+                    param->setValueNotifyingHost(random.nextFloat());
+                }
+                else if (action < 92) {
+                    processor.storePreset(random.nextInt(PresetBank::numSlots));
+                }
+                else if (action < 97) {
+                    // Unstored slots are allowed, the processor has to keep to its own parameters then
+                    const int a = random.nextInt(PresetBank::numSlots + 1) - 1;
+                    processor.setMorphScenes(a, random.nextInt(PresetBank::numSlots));
+                }
+                else {
+                    processor.setTelemetryEnabled(random.nextBool());
+                }
+
+                if (dense.load()) {
+                    parameters[(size_t)ParamID::density]->setValueNotifyingHost(1.0f);
+                    parameters[(size_t)ParamID::densityMultiplier]->setValueNotifyingHost(1.0f);
+                }
+
+                // No message loop runs the processor's timer here
+                processor.updateHistorySize();
+
+                wait(2);
+            }
+        }
+
+    private:
+        AudioPluginAudioProcessor& processor;
+        juce::Random random;
+        std::vector<juce::RangedAudioParameter*> parameters;
+    };
+}
+
+int main(int argc, char* argv[]) {
+   #if defined(__linux__)
+    RealtimeCheck::resolveOriginals();
+   #endif
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h")) {
+        printUsage();
+        return 0;
+    }
+
+    const int numBlocks = args.containsOption("--blocks") ? juce::jmax(1, args.getValueForOption("--blocks").getIntValue()) : 20000;
+    const int maxBlock = args.containsOption("--max-block") ? juce::jmax(1, args.getValueForOption("--max-block").getIntValue()) : 1024;
+    const int seed = args.containsOption("--seed") ? args.getValueForOption("--seed").getIntValue() : 1;
+    if (args.containsOption("--traces")) RealtimeCheck::maxTraces = juce::jmax(0, args.getValueForOption("--traces").getIntValue());
+
+    constexpr double sampleRate = 48000.0;
+
+    AudioPluginAudioProcessor processor;
+    processor.setRenderThreads(args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue() : 2);
+
+    processor.setPlayConfigDetails(2, 2, sampleRate, maxBlock);
+    processor.prepareToPlay(sampleRate, maxBlock);
+
+    juce::AudioBuffer<float> audio(2, maxBlock);
+    juce::MidiBuffer midi;
+    juce::Random random(seed);
+
+    Automation automation(processor, seed + 1);
+    automation.startThread();
+
+    // Signal and silence in stretches long enough for the history to go quiet and the processor to idle.
+    // Every other stretch of signal holds a cloud dense enough for the helpers.
+    int stretchBlocks = 0;
+    int signalStretches = 0;
+    bool silent = false;
+
+    for (int blockIndex = 0; blockIndex < numBlocks; ++blockIndex) {
+        if (--stretchBlocks <= 0) {
+            silent = !silent;
+            stretchBlocks = silent ? 500 + random.nextInt(2000) : 50 + random.nextInt(500);
+            automation.dense = !silent && ++signalStretches % 2 == 0;
+        }
+
+        const int numSamples = 1 + random.nextInt(maxBlock);
+        juce::AudioBuffer<float> block(audio.getArrayOfWritePointers(), 2, 0, numSamples);
+
+        for (int channel = 0; channel < 2; ++channel) {
+            float* samples = block.getWritePointer(channel);
+            for (int i = 0; i < numSamples; ++i)
+                samples[i] = silent ? 0.0f : random.nextFloat() * 0.5f - 0.25f;
+        }
+
+        {
+            RealtimeCheck::ScopedArm arm;
+            processor.processBlock(block, midi);
+        }
+    }
+
+    automation.stopThread(1000);
+
+    const auto stats = processor.getPerformanceStats();
+    processor.releaseResources();
+
+    const int violations = RealtimeCheck::violations.load();
+    std::cout << numBlocks << " blocks, " << (juce::int64)stats.idleBlocks << " idle, peak " << stats.peakActiveGrains
+              << " grains: " << (violations == 0 ? juce::String("realtime safe") : juce::String(violations) + " violations")
+              << std::endl;
+
+    const bool helpersRan = processor.getRenderThreads() == 0 || stats.peakActiveGrains >= GrainPool::parallelMinGrains;
+    if (!helpersRan)
+        std::cout << "The cloud never reached " << GrainPool::parallelMinGrains << " grains, so the helpers were never checked" << std::endl;
+
+    return violations == 0 && helpersRan ? 0 : 1;
+}